@@ -0,0 +1,350 @@
+#include "CrashJournal.h"
+#include "PieceTable.h"
+
+#include <FL/Fl_Text_Buffer.H>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>  // For rename, remove
+#include <cstdlib> // For getenv
+#include <cstring> // For memcpy, memchr
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h> // For flock
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct CrashJournal::Shared {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<char> pending;  // Records not yet handed to the writer
+    int fd = -1;                // Open journal, or -1 when not journalling
+    bool writing = false;       // The writer is writing a batch outside the lock
+    bool thread_started = false;
+};
+
+std::string CrashJournal::path_for(const char *path) {
+    if (!path || !*path) {
+        const char *home = getenv("HOME");
+        return std::string(home && *home ? home : "/tmp") + "/.textEditor-untitled.journal";
+    }
+    std::string p = path;
+#ifdef _WIN32
+    size_t slash = p.find_last_of("/\\");
+#else
+    size_t slash = p.find_last_of('/');
+#endif
+    size_t base = (slash == std::string::npos) ? 0 : slash + 1;
+    return p.substr(0, base) + "." + p.substr(base) + ".journal";
+}
+
+const int CrashJournal::COMMIT_MS; // Bound to a reference by std::chrono::milliseconds
+
+CrashJournal::CrashJournal() : s_(new Shared) {}
+
+void CrashJournal::swap(CrashJournal &o) {
+    std::swap(s_, o.s_);
+    path_.swap(o.path_);
+    std::swap(logged_, o.logged_);
+    std::swap(replaying_, o.replaying_);
+}
+
+#ifndef _WIN32
+
+// --- File Format ---
+// Header: MAGIC, then the size, modification time (nanoseconds) and inode of the saved
+// file the records apply to, all int64, so a file rewritten since never gets them. Records: op ('I' insert, 'D' delete), position and
+// length as int32, the inserted bytes for 'I', then an FNV-1a checksum of all that.
+// Integers are in host order: a journal is only ever read back on the machine that wrote it.
+
+static const char MAGIC[8] = { 'T', 'E', 'J', 'R', 'N', 'L', '2', '\n' };
+static const int HEADER_SIZE = 8 + 3 * 8;
+static const int RECORD_HEAD = 1 + 4 + 4;
+static const size_t COMMIT_BYTES = 1 << 20; // Commit at once when this much has gathered
+static const size_t BATCH_RESERVE = 64 * 1024; // Fast typing between two commits fits without reallocating
+
+static uint32_t checksum(const char *p, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)p[i]) * 16777619u;
+    return h;
+}
+
+// Appends one record; 'doc' supplies the inserted bytes of an 'I' record
+static void put_record(std::vector<char> &out, char op, int pos, int len, const PieceTable *doc) {
+    size_t at = out.size();
+    size_t body = RECORD_HEAD + (doc ? (size_t)len : 0);
+    out.resize(at + body + 4);
+    char *p = &out[at];
+    p[0] = op;
+    memcpy(p + 1, &pos, 4);
+    memcpy(p + 5, &len, 4);
+    if (doc) doc->copy(pos, pos + len, p + RECORD_HEAD);
+    uint32_t sum = checksum(p, body);
+    memcpy(p + body, &sum, 4);
+}
+
+// Calls f(op, pos, len, text) for each intact record in data[from, end); returns the
+// offset just past the last one that was intact (and that f accepted)
+template <class F>
+static size_t for_each_record(std::string &data, size_t from, F f) {
+    size_t at = from;
+    while (data.size() - at >= (size_t)RECORD_HEAD + 4) {
+        char *p = &data[at];
+        int pos, len;
+        memcpy(&pos, p + 1, 4);
+        memcpy(&len, p + 5, 4);
+        if ((p[0] != 'I' && p[0] != 'D') || pos < 0 || len <= 0) break;
+        size_t body = RECORD_HEAD + (p[0] == 'I' ? (size_t)len : 0);
+        if (data.size() - at < body + 4) break; // Torn write
+        uint32_t sum;
+        memcpy(&sum, p + body, 4);
+        if (sum != checksum(p, body)) break;
+        if (!f(p[0], pos, len, p + RECORD_HEAD)) break;
+        at += body + 4;
+    }
+    return at;
+}
+
+// --- Disk Access ---
+
+// Size, modification time in nanoseconds and inode of 'path'
+static bool file_stamp(const char *path, int64_t stamp[3]) {
+    stamp[0] = stamp[1] = stamp[2] = 0;
+    if (!*path) return true; // An untitled document starts out empty
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    stamp[0] = st.st_size;
+#ifdef __APPLE__
+    stamp[1] = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    stamp[1] = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    stamp[2] = (int64_t)st.st_ino;
+    return true;
+}
+
+static bool write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        p += w;
+        len -= (size_t)w;
+    }
+    return true;
+}
+
+static bool sync_data(int fd) {
+#ifdef __APPLE__
+    return fsync(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+static bool read_file(const std::string &name, std::string *out) {
+    FILE *fp = fopen(name.c_str(), "rb");
+    if (!fp) return false;
+    char block[65536];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), fp)) > 0) out->append(block, n);
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+// A journal is locked by the editor writing it, so another instance editing the same
+// file (or its own untitled document) is not mistaken for a crashed session
+static bool in_use(const std::string &name) {
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool locked = flock(fd, LOCK_SH | LOCK_NB) != 0 && errno == EWOULDBLOCK;
+    close(fd);
+    return locked;
+}
+
+// Reads the journal for 'path' if its header matches the file as it is on disk now
+static bool read_journal(const char *path, std::string *data) {
+    int64_t stamp[3];
+    std::string name = CrashJournal::path_for(path);
+    if (!file_stamp(path, stamp) || in_use(name)) return false;
+    if (!read_file(name, data) || data->size() < (size_t)HEADER_SIZE) return false;
+    if (memcmp(data->data(), MAGIC, 8) != 0) return false;
+    return memcmp(data->data() + 8, stamp, sizeof(stamp)) == 0;
+}
+
+// --- Writer Thread ---
+// Waits for records, lets more gather for up to COMMIT_MS, then writes and syncs the
+// whole batch with the lock released. The two buffers swap, so neither reallocates
+// once they have grown to the usual batch size, and both start with room for one.
+void CrashJournal::writer(Shared *s) {
+    std::vector<char> batch;
+    batch.reserve(BATCH_RESERVE);
+    std::unique_lock<std::mutex> lock(s->mutex);
+    s->pending.reserve(BATCH_RESERVE);
+    for (;;) {
+        s->cv.wait(lock, [s] { return !s->pending.empty(); });
+        s->cv.wait_for(lock, std::chrono::milliseconds(COMMIT_MS),
+                       [s] { return s->pending.size() >= COMMIT_BYTES; });
+        if (s->pending.empty() || s->fd < 0) continue; // start() or stop() took it
+        batch.swap(s->pending);
+        int fd = s->fd;
+        s->writing = true;
+        lock.unlock();
+        // A failed write leaves a shorter journal; recovery stops at the last intact record
+        if (write_all(fd, batch.data(), batch.size())) sync_data(fd);
+        batch.clear();
+        lock.lock();
+        s->writing = false;
+        s->cv.notify_all();
+    }
+}
+
+// --- Journalling (UI thread) ---
+
+bool CrashJournal::active() const {
+    return s_->fd >= 0; // Only the UI thread changes it
+}
+
+void CrashJournal::record(int pos, int nInserted, int nDeleted, const PieceTable &doc) {
+    if (s_->fd < 0 || replaying_ || (nInserted <= 0 && nDeleted <= 0)) return;
+    std::lock_guard<std::mutex> lock(s_->mutex);
+    size_t before = s_->pending.size();
+    if (nDeleted > 0) put_record(s_->pending, 'D', pos, nDeleted, nullptr); // A replace deletes first
+    if (nInserted > 0) put_record(s_->pending, 'I', pos, nInserted, &doc);
+    logged_ += (long long)(s_->pending.size() - before);
+    if (before == 0 || s_->pending.size() >= COMMIT_BYTES) s_->cv.notify_all();
+}
+
+void CrashJournal::start(const char *path, long long carry_from) {
+    std::string name = path_for(path);
+    std::string carried;
+    std::unique_lock<std::mutex> lock(s_->mutex);
+    s_->cv.wait(lock, [this] { return !s_->writing; });
+    if (s_->fd >= 0 && carry_from >= 0 && carry_from < logged_) {
+        // The records from the mark on: what the writer has written, then what is pending
+        long long written = logged_ - (long long)s_->pending.size();
+        size_t on_disk = carry_from < written ? (size_t)(written - carry_from) : 0;
+        if (on_disk > 0) {
+            carried.resize(on_disk);
+            ssize_t n = pread(s_->fd, &carried[0], on_disk, HEADER_SIZE + carry_from);
+            carried.resize(n > 0 ? (size_t)n : 0);
+        }
+        if (carried.size() == on_disk) {
+            size_t skip = carry_from > written ? (size_t)(carry_from - written) : 0;
+            carried.append(s_->pending.data() + skip, s_->pending.size() - skip);
+        } else {
+            carried.clear(); // Could not read them back; the new journal starts empty
+        }
+    }
+    s_->pending.clear();
+    if (s_->fd >= 0) close(s_->fd);
+    s_->fd = -1;
+    if (!path_.empty() && path_ != name) remove(path_.c_str());
+    path_.clear();
+    logged_ = 0;
+
+    // Written under a temporary name and renamed, so a journal on disk is never half made.
+    // If it cannot be created (say, a read-only directory) the document is not journalled.
+    // Nor is it if another editor is journalling the same file.
+    int64_t head[3];
+    if (!file_stamp(path, head) || in_use(name)) return;
+    std::string tmp = name + ".tmp";
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if (fd < 0) return;
+    bool ok = flock(fd, LOCK_EX | LOCK_NB) == 0 && write_all(fd, MAGIC, 8) && write_all(fd, (const char *)head, sizeof(head)) &&
+              write_all(fd, carried.data(), carried.size()) && sync_data(fd) &&
+              rename(tmp.c_str(), name.c_str()) == 0;
+    if (!ok) {
+        close(fd);
+        remove(tmp.c_str());
+        return;
+    }
+    s_->fd = fd;
+    path_ = name;
+    logged_ = (long long)carried.size();
+    if (!s_->thread_started) {
+        s_->thread_started = true;
+        std::thread(writer, s_).detach();
+    }
+}
+
+void CrashJournal::stop() {
+    std::unique_lock<std::mutex> lock(s_->mutex);
+    s_->cv.wait(lock, [this] { return !s_->writing; });
+    s_->pending.clear();
+    if (s_->fd >= 0) close(s_->fd);
+    s_->fd = -1;
+    if (!path_.empty()) remove(path_.c_str());
+    path_.clear();
+    logged_ = 0;
+}
+
+// --- Recovery ---
+
+bool CrashJournal::found(const char *path) const {
+    std::string data;
+    if (!read_journal(path, &data)) return false;
+    return for_each_record(data, HEADER_SIZE, [](char, int, int, const char *) { return true; }) > (size_t)HEADER_SIZE;
+}
+
+int CrashJournal::replay(const char *path, Fl_Text_Buffer &buf) {
+    std::string data;
+    if (!read_journal(path, &data)) return -1;
+    int applied = 0;
+    replaying_ = true;
+    size_t end = for_each_record(data, HEADER_SIZE, [&](char op, int pos, int len, const char *text) {
+        if (op == 'D') {
+            if (pos + len > buf.length()) return false;
+            buf.remove(pos, pos + len);
+        } else {
+            if (pos > buf.length() || memchr(text, '\0', len)) return false;
+            char *t = (char *)text;
+            char saved = t[len]; // First checksum byte: already verified, lend it as the terminator
+            t[len] = '\0';
+            buf.insert(pos, t);
+            t[len] = saved;
+        }
+        applied++;
+        return true;
+    });
+    replaying_ = false;
+    if (applied == 0) return -1;
+
+    // Carry on in the same journal, minus any torn or unusable tail
+    stop(); // Closes a journal that might still be in use (the file's is not: replay comes first)
+    std::string name = path_for(path);
+    int fd = open(name.c_str(), O_RDWR | O_APPEND);
+    if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) != 0 || ftruncate(fd, (off_t)end) != 0) {
+        if (fd >= 0) close(fd);
+        return applied;
+    }
+    std::lock_guard<std::mutex> lock(s_->mutex);
+    s_->fd = fd;
+    path_ = name;
+    logged_ = (long long)(end - HEADER_SIZE);
+    if (!s_->thread_started) {
+        s_->thread_started = true;
+        std::thread(writer, s_).detach();
+    }
+    return applied;
+}
+
+#else // _WIN32: no journal; the document is only in memory until it is saved
+
+void CrashJournal::writer(Shared *) {}
+bool CrashJournal::active() const { return false; }
+void CrashJournal::record(int, int, int, const PieceTable &) {}
+void CrashJournal::start(const char *, long long) {}
+void CrashJournal::stop() {}
+bool CrashJournal::found(const char *) const { return false; }
+int CrashJournal::replay(const char *, Fl_Text_Buffer &) { return -1; }
+
+#endif
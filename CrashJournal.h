@@ -0,0 +1,60 @@
+#ifndef CRASHJOURNAL_H
+#define CRASHJOURNAL_H
+
+#include <cstddef>
+#include <string>
+
+class Fl_Text_Buffer;
+class PieceTable;
+
+// --- Crash Recovery Journal ---
+// Every edit to the document is appended to a journal file next to it (".name.journal",
+// or ~/.textEditor-untitled.journal for an untitled document) as a compact insert or
+// delete record. Recording only copies the record into a memory buffer; a writer thread
+// commits whatever has gathered every COMMIT_MS (or sooner when a lot has) with a single
+// write and fdatasync, so typing never waits for the disk.
+//
+// The journal's header names the saved file it applies to (size and modification time).
+// After a crash, loading that file again finds the journal and replays its records in
+// one pass. Each record carries a checksum, so a torn last write is simply ignored.
+// A successful save starts a fresh journal; a clean exit removes it.
+class CrashJournal {
+public:
+    static const int COMMIT_MS = 200;
+
+    CrashJournal();
+
+    // Starts journalling the document just loaded from or saved to 'path' ("" when
+    // untitled). With 'carry_from' >= 0, the records logged after that mark() are kept:
+    // they are edits made while the save that produced 'path' was being written.
+    // A journal of another file in use until now is removed.
+    void start(const char *path, long long carry_from = -1);
+    void stop(); // Ends journalling and removes the journal (the document was saved or discarded)
+    bool active() const;
+    long long mark() const { return logged_; } // Record bytes logged since the last start()
+
+    // Called after the edit is in 'doc' (the inserted bytes are read from there)
+    void record(int pos, int nInserted, int nDeleted, const PieceTable &doc);
+
+    // True if a journal with at least one intact record exists for the file at 'path'
+    // as it is on disk now
+    bool found(const char *path) const;
+    // Replays that journal onto 'buf' (holding the file's text) and carries on
+    // journalling into it. Returns the number of records applied, or -1 if none could be.
+    int replay(const char *path, Fl_Text_Buffer &buf);
+    bool replaying() const { return replaying_; }
+
+    static std::string path_for(const char *path);
+    void swap(CrashJournal &o); // Exchanges journals (and writer threads) with 'o'
+
+private:
+    struct Shared;
+    static void writer(Shared *s);
+
+    Shared *s_;          // State shared with the writer thread (never freed: the thread is detached)
+    std::string path_;   // Journal file name
+    long long logged_ = 0;
+    bool replaying_ = false;
+};
+
+#endif // CRASHJOURNAL_H
@@ -1,12 +1,78 @@
 #include "EditorWindow.h"
 #include "callbacks.h" // For setting widget callbacks
 #include "syntax.h"    // For styletable access and styletable_size
-#include "globals.h"   // For textbuf, stylebuf access
+#include "globals.h"   // For textbuf, stylebuf, line_index access
+#include "loader.h"    // TextView ignores edits while a file loads
+#include "redisplay.h" // For damage_status
+#include "workspace.h" // For the document tabs
 
 #include <FL/fl_ask.H> // For fl_choice, fl_alert etc. (if needed directly here, though unlikely)
+#include <cstdio>      // For snprintf
+#include <cstring>     // For strcmp, strcpy
+
+// --- TextView Implementation ---
+
+static TextView *focused_view = nullptr; // Cleared by ~EditorWindow() when its view goes
+
+TextView *TextView::last_focused() {
+    return focused_view;
+}
+
+// While a file streams in, keys that would edit are swallowed and Escape stops the load.
+// Moving around, selecting and copying still work; other shortcuts go on to the menu,
+// whose editing commands check load_busy() themselves.
+int TextView::handle(int event) {
+    if (load_busy()) {
+        if (event == FL_PASTE || event == FL_DND_RELEASE) return 1;
+        if (event == FL_KEYBOARD) {
+            int key = Fl::event_key();
+            if (key == FL_Escape) {
+                load_cancel();
+                return 1;
+            }
+            bool navigation = key >= FL_Home && key <= FL_End;
+            bool copy = Fl::event_state(FL_CTRL) && (key == 'c' || key == 'a');
+            if (!navigation && !copy) return Fl::event_state(FL_CTRL | FL_ALT | FL_META) ? 0 : 1;
+        }
+    }
+    if (event == FL_FOCUS) focused_view = this;
+    int handled = Fl_Text_Editor::handle(event);
+    damage_status(); // The cursor may have moved
+    return handled;
+}
+
+// FLTK scrolls by walking the lines between the old and the new top line, which takes
+// a while across millions of lines. When the cursor is off screen, the line index gives
+// the start of the new top line directly, and the display is repositioned there.
+// Line wrapping (never enabled here) would make display lines differ from buffer lines.
+void TextView::show_insert_line() {
+    int pos = insert_position();
+    if (!mContinuousWrap && (pos < mFirstChar || pos > mLastChar)) {
+        int top = line_index.line_of(pos) - mNVisibleLines / 2; // Centre the cursor line
+        if (top < 0) top = 0;
+        mFirstChar = line_index.line_start(top);
+        mTopLineNum = mAbsTopLineNum = top + 1;
+        calc_line_starts(0, mNVisibleLines);
+        calc_last_char();
+        update_v_scrollbar();
+        redraw();
+    }
+    show_insert_position(); // Horizontal scrolling, and vertical when the line was close
+}
+
+void TextView::draw() {
+    style_visible(mFirstChar, mLastChar); // Large documents are styled as they come into view
+    PerfScope timer(PERF_DRAW);
+    Fl_Text_Editor::draw();
+}
 
 // --- EditorWindow Implementation ---
 
+static const int PERF_BAR_HEIGHT = 20;
+static const int STATUS_WIDTH = 160;
+static const int TAB_HEIGHT = 25;
+static const int EDITOR_TOP = 30 + TAB_HEIGHT; // Below the menu bar and the tabs
+
 EditorWindow::EditorWindow(int W, int H, const char* t)
     : Fl_Double_Window(W, H, t) {
 
@@ -16,7 +82,7 @@ EditorWindow::EditorWindow(int W, int H, const char* t)
     search[0] = '\0'; // Initialize search string for this window
 
     // --- Create Menu Bar ---
-    menu = new Fl_Menu_Bar(0, 0, W, 30);
+    menu = new Fl_Menu_Bar(0, 0, W - STATUS_WIDTH, 30);
 
     // Define Menu Items (Callbacks are defined in callbacks.cpp)
     Fl_Menu_Item menuitems[] = {
@@ -25,13 +91,15 @@ EditorWindow::EditorWindow(int W, int H, const char* t)
             { "&Open File...",  FL_CTRL | 'o', (Fl_Callback *)open_cb, 0 },
             { "&Insert File...", FL_CTRL | 'i', (Fl_Callback *)insert_cb, this, FL_MENU_DIVIDER },
             { "&Save File",     FL_CTRL | 's', (Fl_Callback *)save_cb, 0 },
-            { "Save File &As...", FL_CTRL | FL_SHIFT | 's', (Fl_Callback *)saveas_cb, 0, FL_MENU_DIVIDER },
+            { "Save File &As...", FL_CTRL | FL_SHIFT | 's', (Fl_Callback *)saveas_cb, 0 },
+            { "Close &File",    FL_CTRL | FL_SHIFT | 'w', (Fl_Callback *)closefile_cb, 0, FL_MENU_DIVIDER },
             { "New &View",      FL_ALT | 'v', (Fl_Callback *)view_cb, 0 },
             { "&Close View",    FL_CTRL | 'w', (Fl_Callback *)close_cb, this, FL_MENU_DIVIDER },
             { "E&xit",          FL_CTRL | 'q', (Fl_Callback *)quit_cb, 0 },
             { 0 },
         { "&Edit",              0, 0, 0, FL_SUBMENU },
-            { "&Undo",          FL_CTRL | 'z', (Fl_Callback *)undo_cb, 0, FL_MENU_DIVIDER },
+            { "&Undo",          FL_CTRL | 'z', (Fl_Callback *)undo_cb, this },
+            { "&Redo",          FL_CTRL | FL_SHIFT | 'z', (Fl_Callback *)redo_cb, this, FL_MENU_DIVIDER },
             { "Cu&t",           FL_CTRL | 'x', (Fl_Callback *)cut_cb, this },
             { "&Copy",          FL_CTRL | 'c', (Fl_Callback *)copy_cb, this },
             { "&Paste",         FL_CTRL | 'v', (Fl_Callback *)paste_cb, this },
@@ -40,15 +108,37 @@ EditorWindow::EditorWindow(int W, int H, const char* t)
         { "&Search",            0, 0, 0, FL_SUBMENU },
             { "&Find...",       FL_CTRL | 'f', (Fl_Callback *)find_cb, this },
             { "F&ind Again",    FL_CTRL | 'g', (Fl_Callback *)find2_cb, this },
+            { "Find A&ll...",   FL_CTRL | FL_SHIFT | 'f', (Fl_Callback *)findall_cb, this },
             { "&Replace...",    FL_CTRL | 'r', (Fl_Callback *)replace_cb, this },
-            { "Re&place Again", FL_CTRL | 't', (Fl_Callback *)replace2_cb, this },
+            { "Re&place Again", FL_CTRL | 't', (Fl_Callback *)replace2_cb, this, FL_MENU_DIVIDER },
+            { "&Go To Line...", FL_CTRL | 'l', (Fl_Callback *)goto_cb, this, FL_MENU_DIVIDER },
+            { "Match &Case",    0,             (Fl_Callback *)matchcase_cb, this, FL_MENU_TOGGLE },
+            { "&Whole Word",    0,             (Fl_Callback *)wholeword_cb, this, FL_MENU_TOGGLE },
+            { "Regular E&xpression", 0,        (Fl_Callback *)regex_cb, this, FL_MENU_TOGGLE },
+            { 0 },
+        { "&View",              0, 0, 0, FL_SUBMENU },
+            { "Performance &Overlay", FL_CTRL | FL_SHIFT | 'p', (Fl_Callback *)perf_cb, this, FL_MENU_TOGGLE },
+            { "Save Performance &Trace...", 0, (Fl_Callback *)perftrace_cb, 0 },
             { 0 },
         { 0 }
     };
     menu->copy(menuitems); // Assign menu items to the menu bar
 
+    // --- Create Line:Column Display (fills the rest of the menu bar row) ---
+    status = new Fl_Box(W - STATUS_WIDTH, 0, STATUS_WIDTH, 30);
+    status->box(FL_UP_BOX);
+    status->align(FL_ALIGN_RIGHT | FL_ALIGN_INSIDE | FL_ALIGN_CLIP);
+    status->labelsize(12);
+
+    // --- Create Document Tabs ---
+    // The tabs are only a strip: each is an empty group just below it, and every
+    // document is shown in the one editor (see update_tabs())
+    tabs = new Fl_Tabs(0, 30, W, TAB_HEIGHT);
+    tabs->callback(tab_cb, this);
+    tabs->end();
+
     // --- Create Text Editor ---
-    editor = new Fl_Text_Editor(0, 30, W, H - 30);
+    editor = new TextView(0, EDITOR_TOP, W, H - EDITOR_TOP);
     editor->buffer(&textbuf); // Use the global text buffer
     editor->textfont(styletable[0].font); // Set default font from style table
     editor->textsize(styletable[0].size); // Set default size from style table
@@ -58,6 +148,13 @@ EditorWindow::EditorWindow(int W, int H, const char* t)
                            styletable_size, // Use the variable defined in syntax.cpp
                            'A', 0, 0); // 'A' is the default style character
 
+    // --- Create Performance Overlay (shown by View > Performance Overlay) ---
+    perf_bar = new Fl_Box(0, H, W, PERF_BAR_HEIGHT);
+    perf_bar->box(FL_THIN_UP_BOX);
+    perf_bar->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE | FL_ALIGN_CLIP);
+    perf_bar->labelsize(12);
+    perf_bar->hide();
+
     // --- Window Properties ---
     this->resizable(editor); // Make the editor widget resizable
     this->size_range(300, 200); // Minimum window size
@@ -80,12 +177,68 @@ EditorWindow::EditorWindow(int W, int H, const char* t)
     replace_dlg->end(); // End of replace_dlg group
     replace_dlg->set_non_modal(); // Allow interaction with main window
 
+    // --- Create Find All Results Panel ---
+    findall_dlg = new Fl_Window(500, 300, "Find All");
+    {
+        findall_list = new Fl_Hold_Browser(0, 0, 500, 300);
+        findall_list->format_char(0); // Show lines verbatim ('@' is not a format prefix)
+        findall_list->callback(findall_pick_cb, this);
+        findall_dlg->resizable(findall_list);
+    }
+    findall_dlg->end();
+    findall_dlg->set_non_modal();
+
     // Set the callback for the window's close button ('X')
     this->callback((Fl_Callback *)close_cb, this);
 
     // Note: Global buffer callbacks (changed_cb, style_update) are added in main.cpp
 }
 
+void EditorWindow::show_perf_bar(bool on) {
+    int bar = on ? PERF_BAR_HEIGHT : 0;
+    editor->resize(0, EDITOR_TOP, w(), h() - EDITOR_TOP - bar);
+    perf_bar->resize(0, h() - bar, w(), PERF_BAR_HEIGHT);
+    if (on) perf_bar->show(); else perf_bar->hide();
+    init_sizes(); // Resizing the window keeps this layout
+    redraw();
+}
+
+void EditorWindow::update_status() {
+    int pos = editor->insert_position();
+    int line = line_index.line_of(pos);
+    char text[sizeof(status_text)];
+    snprintf(text, sizeof(text), "Ln %d of %d, Col %d  ", line + 1, line_index.lines(),
+             pos - line_index.line_start(line) + 1);
+    if (strcmp(status_text, text) == 0) return;
+    strcpy(status_text, text);
+    status->label(status_text); // Not copy_label(): that frees and duplicates on every keystroke
+}
+
+void EditorWindow::update_tabs() {
+    int count = document_count();
+    while (tabs->children() > count) {
+        Fl_Widget *tab = tabs->child(tabs->children() - 1);
+        tabs->remove(tab);
+        delete tab;
+    }
+    while (tabs->children() < count) {
+        Fl_Group::current(nullptr); // Not into whatever group happens to be open
+        Fl_Group *tab = new Fl_Group(0, EDITOR_TOP, w(), 0);
+        tab->end();
+        tabs->add(tab);
+    }
+    for (int i = 0; i < count; i++) {
+        char label[sizeof(filename) + 8];
+        document_label(i, label, sizeof(label));
+        Fl_Widget *tab = tabs->child(i);
+        if (!tab->label() || strcmp(tab->label(), label) != 0) {
+            tab->copy_label(label);
+            tabs->redraw();
+        }
+    }
+    tabs->value(tabs->child(document_active()));
+}
+
 EditorWindow::~EditorWindow() {
     // Remove this window's pointer from the global list
     for (size_t i = 0; i < windows.size(); ++i) {
@@ -101,6 +254,12 @@ EditorWindow::~EditorWindow() {
         delete replace_dlg;
         replace_dlg = nullptr; // Avoid dangling pointer
     }
+    if (findall_dlg) {
+        findall_dlg->hide();
+        delete findall_dlg;
+        findall_dlg = nullptr;
+    }
+    if (focused_view == editor) focused_view = nullptr;
     // Child widgets (menu, editor) are automatically deleted by FLTK
     // when the parent window (this) is deleted.
 }
@@ -7,6 +7,29 @@
 #include <FL/Fl_Input.H>
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Return_Button.H>
+#include <FL/Fl_Hold_Browser.H>
+#include <FL/Fl_Box.H>
+#include <FL/Fl_Tabs.H>
+#include "Regex.h"
+#include "FindAll.h"
+#include "Perf.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+// --- TextView: Fl_Text_Editor that reports its visible range ---
+class TextView : public Fl_Text_Editor {
+public:
+    TextView(int X, int Y, int W, int H, const char* l = 0) : Fl_Text_Editor(X, Y, W, H, l) {
+        remove_key_binding('z', FL_CTRL); // Leave Ctrl+Z to the Edit menu's journal-based Undo
+    }
+    int first_visible() const { return mFirstChar; } // Buffer position of the top line
+    int last_visible() const { return mLastChar; }   // Buffer position just past the last visible line
+    int handle(int event) override; // Keeps the document read-only while a file loads
+    void show_insert_line(); // show_insert_position() that jumps straight to a far away line
+    void draw() override; // Styles what is about to show first (see style_visible())
+    static TextView *last_focused(); // The view the user last worked in, or nullptr
+};
 
 // --- EditorWindow Class Definition ---
 class EditorWindow : public Fl_Double_Window {
@@ -17,7 +40,10 @@ public:
 
     // --- Widgets ---
     Fl_Menu_Bar* menu = nullptr;
-    Fl_Text_Editor* editor = nullptr;
+    TextView* editor = nullptr;
+    Fl_Box* perf_bar = nullptr; // Performance overlay status line, hidden unless toggled on
+    Fl_Box* status = nullptr;   // Line and column of the cursor, right of the menu bar
+    Fl_Tabs* tabs = nullptr;    // One tab per open document, below the menu bar
 
     // Replace Dialog Widgets (owned by this window)
     Fl_Window      *replace_dlg = nullptr;
@@ -27,9 +53,21 @@ public:
     Fl_Return_Button *replace_next = nullptr;
     Fl_Button      *replace_cancel = nullptr;
 
+    // Find All results panel (owned by this window)
+    Fl_Window      *findall_dlg = nullptr;
+    Fl_Hold_Browser *findall_list = nullptr;
+
     // --- State ---
     char search[256];      // Per-window search term storage
+    int search_flags = 0;  // SEARCH_MATCH_CASE / SEARCH_WHOLE_WORD / SEARCH_REGEX for Find and Replace
+    std::unique_ptr<Regex> regex; // Last compiled regex; reused while the pattern and flags are unchanged
+    std::vector<FindResult> findall_results; // Entries of findall_list, in order
     int window_number;     // Unique identifier for the view
+    void show_perf_bar(bool on); // Shows or hides perf_bar, resizing the editor to make room
+    void update_status();  // Relabels 'status' for the current cursor position
+    void update_tabs();    // Matches 'tabs' to the workspace's documents and selects the active one
+    std::string title;     // Label last set by set_title()
+    char status_text[64] = ""; // Label of 'status', rewritten in place as the cursor moves
 };
 
 #endif // EDITORWINDOW_H
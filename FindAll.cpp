@@ -0,0 +1,122 @@
+#include "FindAll.h"
+#include "ThreadPool.h"
+#include "Perf.h"
+
+#include <cstring> // For memchr
+
+namespace {
+const int MIN_RANGE = 256 * 1024; // Smaller ranges cost more in hand-off than they save
+
+struct Hit {
+    int start, end;
+    int newlines;     // Newlines between the range start and the match
+    int line_start;   // Position of the '\n' before the match inside the range, or -1
+};
+
+struct RangeResult {
+    std::vector<Hit> hits;
+    int newlines = 0;      // In the whole range
+    int last_newline = -1; // Position of the range's last '\n', or -1
+};
+
+// Counts newlines in [from, to), updating *last with the position of the last one seen
+int count_newlines(const PieceSnapshot &snap, int from, int to, int *last) {
+    int n = 0;
+    int pos = from;
+    snap.for_each_chunk(from, to, [&](const char *chunk, int len) {
+        for (const char *p = chunk, *end = chunk + len;
+             (p = (const char *)memchr(p, '\n', end - p)) != nullptr; p++) {
+            n++;
+            *last = pos + (int)(p - chunk);
+        }
+        pos += len;
+    });
+    return n;
+}
+
+// Where the scan resumes after a match: past it, or one byte on after an empty match
+inline int next_from(int start, int end) { return end > start ? end : end + 1; }
+}
+
+int find_all(const PieceSnapshot &snap, const FindAllMatcher &match, std::vector<FindResult> *results,
+             size_t max_results) {
+    int total = snap.length();
+    PerfScope timer(PERF_FIND_ALL, total);
+    ThreadPool &pool = ThreadPool::shared();
+    int ranges = total / MIN_RANGE;
+    if (ranges > pool.size() * 4) ranges = pool.size() * 4;
+    if (ranges < 1) ranges = 1;
+    std::vector<int> bounds(ranges + 1);
+    for (int r = 0; r <= ranges; r++) bounds[r] = (int)((long long)total * r / ranges);
+    bounds[ranges] = total + 1; // The last range may hold an empty match at the very end
+
+    // --- Parallel scan: matches starting in each range, plus its newline counts ---
+    std::vector<RangeResult> found(ranges);
+    pool.parallel_for(ranges, [&](int r) {
+        RangeResult &out = found[r];
+        int lo = bounds[r], hi = bounds[r + 1];
+        int counted = lo, newlines = 0, last = -1;
+        int start, end;
+        for (int from = lo; from < hi && match(snap, from, hi, &start, &end); from = next_from(start, end)) {
+            newlines += count_newlines(snap, counted, start, &last);
+            counted = start;
+            out.hits.push_back({ start, end, newlines, last });
+        }
+        out.newlines = newlines + count_newlines(snap, counted, hi < total ? hi : total, &last);
+        out.last_newline = last;
+    });
+
+    // --- Merge in document order, resolving matches that cross range boundaries ---
+    int count = 0;
+    int line_base = 0;  // Newlines before the current range
+    int last_nl = -1;   // Last '\n' before the current range
+    int resume = 0;     // Where a sequential scan would look for the next match
+    for (int r = 0; r < ranges; r++) {
+        const std::vector<Hit> &hits = found[r].hits;
+        int lo = bounds[r], hi = bounds[r + 1];
+        size_t i = 0;
+        while (i < hits.size() && hits[i].start < resume) {
+            // The previous range's last match overlaps these; scan from where it ended
+            // until this range's own matches line up again
+            int start, end;
+            if (!match(snap, resume, hi, &start, &end)) { i = hits.size(); break; }
+            while (i < hits.size() && hits[i].start < start) i++;
+            if (i < hits.size() && hits[i].start == start) break;
+            int nl_last = -1;
+            int nl = count_newlines(snap, lo, start, &nl_last);
+            if (results->size() < max_results) {
+                int line_start = nl_last >= 0 ? nl_last : last_nl;
+                results->push_back({ start, end, line_base + nl + 1, start - line_start });
+            }
+            count++;
+            resume = next_from(start, end);
+        }
+        for (; i < hits.size(); i++) {
+            const Hit &h = hits[i];
+            if (results->size() < max_results) {
+                int line_start = h.line_start >= 0 ? h.line_start : last_nl;
+                results->push_back({ h.start, h.end, line_base + h.newlines + 1, h.start - line_start });
+            }
+            count++;
+            resume = next_from(h.start, h.end);
+        }
+        line_base += found[r].newlines;
+        if (found[r].last_newline >= 0) last_nl = found[r].last_newline;
+    }
+    return count;
+}
+
+std::string find_all_context(const PieceSnapshot &snap, const FindResult &r) {
+    const int BEFORE = 60, WIDTH = 200;
+    int line_start = r.start - (r.col - 1);
+    int from = r.start - BEFORE > line_start ? r.start - BEFORE : line_start;
+    int to = from + WIDTH < snap.length() ? from + WIDTH : snap.length();
+    std::string text(to - from, '\0');
+    snap.copy(from, to, &text[0]);
+    size_t nl = text.find('\n');
+    if (nl != std::string::npos) text.resize(nl);
+    for (char &c : text) {
+        if (c == '\t' || c == '\r') c = ' ';
+    }
+    return text;
+}
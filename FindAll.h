@@ -0,0 +1,30 @@
+#ifndef FINDALL_H
+#define FINDALL_H
+
+#include "PieceTable.h" // Scans run over document snapshots
+#include <functional>
+#include <string>
+#include <vector>
+
+// --- Find All ---
+// The snapshot is cut into ranges that are scanned in parallel on the shared ThreadPool,
+// each counting its own newlines so line numbers come out of a prefix sum. A match may
+// run past the end of its range; where one overlaps the next range's first matches the
+// merge rescans from its end until the two sequences agree, so the result is exactly
+// what a single front-to-back scan would report.
+
+struct FindResult {
+    int start, end; // Byte range of the match
+    int line, col;  // 1-based
+};
+
+// Finds the first match starting in [from, stop); returns false if there is none
+typedef std::function<bool(const PieceSnapshot &snap, int from, int stop, int *start, int *end)> FindAllMatcher;
+
+// Appends up to 'max_results' matches to 'results' and returns the total number found
+int find_all(const PieceSnapshot &snap, const FindAllMatcher &match, std::vector<FindResult> *results,
+             size_t max_results);
+// The line around a result, trimmed to a readable width, for display in a list
+std::string find_all_context(const PieceSnapshot &snap, const FindResult &r);
+
+#endif // FINDALL_H
@@ -0,0 +1,120 @@
+#ifndef KEYWORDHASH_H
+#define KEYWORDHASH_H
+
+#include <cstddef>
+#include <cstring> // For memcmp
+
+// --- Compile-Time Perfect Hash for Keyword Tables ---
+// Built entirely by the compiler from a constexpr word list (hash and displace: words
+// are grouped into buckets by hash, and each bucket gets a displacement that sends all
+// its words to free slots). Looking up an identifier is one hash over its characters,
+// one slot read and one compare, straight from the text being lexed.
+// A list with duplicate words cannot be hashed: ok() is then false, so declare tables
+// constexpr and static_assert on it.
+
+struct KeywordEntry {
+    const char *word;
+    char style; // Style character for the word
+};
+
+namespace keyword_hash {
+constexpr unsigned fnv(const char *s, int len) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+constexpr unsigned mix(unsigned h) {
+    h ^= h >> 16; h *= 0x7feb352du;
+    h ^= h >> 15; h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+constexpr int length(const char *s) {
+    int n = 0;
+    while (s[n]) n++;
+    return n;
+}
+constexpr size_t slots_for(size_t n) { // Power of two, at most half full
+    size_t m = 1;
+    while (m < 2 * n) m <<= 1;
+    return m;
+}
+}
+
+template <size_t N>
+class KeywordHash {
+public:
+    static constexpr size_t SLOTS = keyword_hash::slots_for(N);
+    static constexpr size_t BUCKETS = N / 2 + 1;
+
+    constexpr explicit KeywordHash(const KeywordEntry (&words)[N]) {
+        unsigned hash[N] = {};
+        int bucket_size[BUCKETS] = {};
+        for (size_t i = 0; i < N; i++) {
+            int len = keyword_hash::length(words[i].word);
+            if (len > max_len_) max_len_ = len;
+            hash[i] = keyword_hash::fnv(words[i].word, len);
+            bucket_size[hash[i] % BUCKETS]++;
+        }
+        // Place the fullest buckets first, while most slots are still free
+        int owner[SLOTS] = {}; // Entry index + 1 per slot, 0 when free
+        ok_ = true;
+        for (int size = (int)N; size > 0 && ok_; size--) {
+            for (size_t b = 0; b < BUCKETS && ok_; b++) {
+                if (bucket_size[b] != size) continue;
+                bool placed = false;
+                for (unsigned d = 0; d < 65536 && !placed; d++) {
+                    placed = true;
+                    for (size_t i = 0; i < N && placed; i++) {
+                        if (hash[i] % BUCKETS != b) continue;
+                        int &o = owner[slot_of(hash[i], d)];
+                        if (o) placed = false;
+                        else o = (int)i + 1;
+                    }
+                    if (placed) {
+                        disp_[b] = (unsigned short)d;
+                        break;
+                    }
+                    for (size_t i = 0; i < N; i++) { // Undo this bucket's partial placement
+                        int &o = owner[slot_of(hash[i], d)];
+                        if (hash[i] % BUCKETS == b && o == (int)i + 1) o = 0;
+                    }
+                }
+                ok_ = placed;
+            }
+        }
+        for (size_t s = 0; s < SLOTS; s++) {
+            if (!owner[s]) continue;
+            const KeywordEntry &w = words[owner[s] - 1];
+            slot_[s] = Slot{ w.word, keyword_hash::length(w.word), w.style };
+        }
+    }
+
+    constexpr bool ok() const { return ok_; }
+    int max_length() const { return max_len_; }
+
+    // Style character for the identifier text[0, len), or 0 if it is not in the table
+    char classify(const char *text, int len) const {
+        if (len > max_len_) return 0;
+        unsigned h = keyword_hash::fnv(text, len);
+        const Slot &s = slot_[slot_of(h, disp_[h % BUCKETS])];
+        return (s.len == len && memcmp(s.word, text, len) == 0) ? s.style : 0;
+    }
+
+private:
+    struct Slot {
+        const char *word = nullptr;
+        int len = 0;
+        char style = 0;
+    };
+    static constexpr size_t slot_of(unsigned h, unsigned d) {
+        return keyword_hash::mix(h ^ (d * 0x9e3779b9u)) & (SLOTS - 1);
+    }
+
+    Slot slot_[SLOTS] = {};
+    unsigned short disp_[BUCKETS] = {};
+    int max_len_ = 0;
+    bool ok_ = false;
+};
+
+#endif // KEYWORDHASH_H
@@ -0,0 +1,241 @@
+#include "Language.h"
+#include "KeywordHash.h" // Compile-time keyword/type lookup
+
+#include <cctype>  // For tolower, isspace
+#include <cstring> // For strlen, strchr, strrchr, memchr, memcmp, memset
+
+// --- Keyword Tables ---
+// Identifiers highlighted as types ('F') or keywords ('G'), one table per language. The
+// perfect hashes are generated from these lists at compile time, so entries can be added
+// freely.
+
+// C and C++
+static constexpr KeywordEntry cpp_words[] = {
+  // Keywords
+  {"and", 'G'}, {"and_eq", 'G'}, {"asm", 'G'}, {"auto", 'G'}, {"bitand", 'G'},
+  {"bitor", 'G'}, {"bool", 'G'}, {"break", 'G'}, {"case", 'G'}, {"catch", 'G'},
+  {"char", 'G'}, {"class", 'G'}, {"compl", 'G'}, {"const", 'G'}, {"const_cast", 'G'},
+  {"continue", 'G'}, {"default", 'G'}, {"delete", 'G'}, {"do", 'G'}, {"double", 'G'},
+  {"dynamic_cast", 'G'}, {"else", 'G'}, {"enum", 'G'}, {"explicit", 'G'}, {"export", 'G'},
+  {"extern", 'G'}, {"false", 'G'}, {"float", 'G'}, {"for", 'G'}, {"friend", 'G'},
+  {"goto", 'G'}, {"if", 'G'}, {"inline", 'G'}, {"int", 'G'}, {"long", 'G'},
+  {"mutable", 'G'}, {"namespace", 'G'}, {"new", 'G'}, {"not", 'G'}, {"not_eq", 'G'},
+  {"operator", 'G'}, {"or", 'G'}, {"or_eq", 'G'}, {"private", 'G'}, {"protected", 'G'},
+  {"public", 'G'}, {"register", 'G'}, {"reinterpret_cast", 'G'}, {"return", 'G'}, {"short", 'G'},
+  {"signed", 'G'}, {"sizeof", 'G'}, {"static", 'G'}, {"static_cast", 'G'}, {"struct", 'G'},
+  {"switch", 'G'}, {"template", 'G'}, {"this", 'G'}, {"throw", 'G'}, {"true", 'G'},
+  {"try", 'G'}, {"typedef", 'G'}, {"typeid", 'G'}, {"typename", 'G'}, {"union", 'G'},
+  {"unsigned", 'G'}, {"using", 'G'}, {"virtual", 'G'}, {"void", 'G'}, {"volatile", 'G'},
+  {"wchar_t", 'G'}, {"while", 'G'}, {"xor", 'G'}, {"xor_eq", 'G'},
+  // FLTK types
+  {"Fl_Widget", 'F'}, {"Fl_Window", 'F'}, {"Fl_Double_Window", 'F'}, {"Fl_Gl_Window", 'F'},
+  {"Fl_Group", 'F'}, {"Fl_Box", 'F'}, {"Fl_Button", 'F'}, {"Fl_Return_Button", 'F'},
+  {"Fl_Check_Button", 'F'}, {"Fl_Light_Button", 'F'}, {"Fl_Round_Button", 'F'},
+  {"Fl_Input", 'F'}, {"Fl_Int_Input", 'F'}, {"Fl_Float_Input", 'F'}, {"Fl_Output", 'F'},
+  {"Fl_Text_Display", 'F'}, {"Fl_Text_Editor", 'F'}, {"Fl_Text_Buffer", 'F'},
+  {"Fl_Menu_", 'F'}, {"Fl_Menu_Bar", 'F'}, {"Fl_Menu_Item", 'F'}, {"Fl_Choice", 'F'},
+  {"Fl_Browser", 'F'}, {"Fl_Hold_Browser", 'F'}, {"Fl_Tabs", 'F'}, {"Fl_Scroll", 'F'},
+  {"Fl_Pack", 'F'}, {"Fl_Tile", 'F'}, {"Fl_Slider", 'F'}, {"Fl_Image", 'F'},
+  {"Fl_File_Chooser", 'F'}, {"Fl_Native_File_Chooser", 'F'}, {"Fl_Callback", 'F'},
+  {"Fl_Color", 'F'}, {"Fl_Font", 'F'}, {"Fl_Fontsize", 'F'}, {"Fl_Boxtype", 'F'},
+  // Standard library types
+  {"size_t", 'F'}, {"ptrdiff_t", 'F'}, {"intptr_t", 'F'}, {"uintptr_t", 'F'},
+  {"int8_t", 'F'}, {"int16_t", 'F'}, {"int32_t", 'F'}, {"int64_t", 'F'},
+  {"uint8_t", 'F'}, {"uint16_t", 'F'}, {"uint32_t", 'F'}, {"uint64_t", 'F'},
+  {"string", 'F'}, {"string_view", 'F'}, {"vector", 'F'}, {"array", 'F'}, {"deque", 'F'},
+  {"list", 'F'}, {"map", 'F'}, {"set", 'F'}, {"unordered_map", 'F'}, {"unordered_set", 'F'},
+  {"pair", 'F'}, {"tuple", 'F'}, {"unique_ptr", 'F'}, {"shared_ptr", 'F'}, {"weak_ptr", 'F'},
+  {"function", 'F'}, {"thread", 'F'}, {"mutex", 'F'}, {"atomic", 'F'}
+};
+static constexpr KeywordHash<sizeof(cpp_words) / sizeof(cpp_words[0])> cpp_table(cpp_words);
+static_assert(cpp_table.ok(), "cpp_words has a duplicate entry");
+static char cpp_classify(const char *word, int len) { return cpp_table.classify(word, len); }
+
+// Python
+static constexpr KeywordEntry python_words[] = {
+  // Keywords
+  {"False", 'G'}, {"None", 'G'}, {"True", 'G'}, {"and", 'G'}, {"as", 'G'}, {"assert", 'G'},
+  {"async", 'G'}, {"await", 'G'}, {"break", 'G'}, {"class", 'G'}, {"continue", 'G'},
+  {"def", 'G'}, {"del", 'G'}, {"elif", 'G'}, {"else", 'G'}, {"except", 'G'},
+  {"finally", 'G'}, {"for", 'G'}, {"from", 'G'}, {"global", 'G'}, {"if", 'G'},
+  {"import", 'G'}, {"in", 'G'}, {"is", 'G'}, {"lambda", 'G'}, {"nonlocal", 'G'},
+  {"not", 'G'}, {"or", 'G'}, {"pass", 'G'}, {"raise", 'G'}, {"return", 'G'}, {"try", 'G'},
+  {"while", 'G'}, {"with", 'G'}, {"yield", 'G'}, {"self", 'G'},
+  // Built-in types
+  {"int", 'F'}, {"float", 'F'}, {"complex", 'F'}, {"bool", 'F'}, {"str", 'F'},
+  {"bytes", 'F'}, {"bytearray", 'F'}, {"list", 'F'}, {"tuple", 'F'}, {"dict", 'F'},
+  {"set", 'F'}, {"frozenset", 'F'}, {"object", 'F'}, {"type", 'F'}, {"range", 'F'},
+  {"Exception", 'F'}
+};
+static constexpr KeywordHash<sizeof(python_words) / sizeof(python_words[0])> python_table(python_words);
+static_assert(python_table.ok(), "python_words has a duplicate entry");
+static char python_classify(const char *word, int len) { return python_table.classify(word, len); }
+
+// JSON
+static constexpr KeywordEntry json_words[] = {
+  {"true", 'G'}, {"false", 'G'}, {"null", 'G'}
+};
+static constexpr KeywordHash<sizeof(json_words) / sizeof(json_words[0])> json_table(json_words);
+static_assert(json_table.ok(), "json_words has a duplicate entry");
+static char json_classify(const char *word, int len) { return json_table.classify(word, len); }
+
+// YAML (JSON's words plus the YAML 1.1 booleans)
+static constexpr KeywordEntry yaml_words[] = {
+  {"true", 'G'}, {"false", 'G'}, {"null", 'G'}, {"True", 'G'}, {"False", 'G'}, {"Null", 'G'},
+  {"yes", 'G'}, {"no", 'G'}, {"on", 'G'}, {"off", 'G'}
+};
+static constexpr KeywordHash<sizeof(yaml_words) / sizeof(yaml_words[0])> yaml_table(yaml_words);
+static_assert(yaml_table.ok(), "yaml_words has a duplicate entry");
+static char yaml_classify(const char *word, int len) { return yaml_table.classify(word, len); }
+
+// --- Language Rules ---
+// C strings carry over newlines, as they always have here (a backslash continuation).
+// Python's triple-quoted strings are lexed as block comments, so docstrings read as such.
+// YAML quotes only open strings at the start of a value, so "note: don't" stays plain.
+
+static const LanguageRules cpp_rules = {
+    "C/C++", "c h cc cpp cxx c++ hh hpp hxx h++ inl ipp tcc ino",
+    "//", "/*", "*/", "", "\"", '\\', '#', true, false, false, cpp_classify
+};
+static const LanguageRules python_rules = {
+    "Python", "py pyw pyi",
+    "#", "\"\"\"", "\"\"\"", "'''", "\"'", '\\', 0, false, false, false, python_classify
+};
+static const LanguageRules json_rules = {
+    "JSON", "json jsonl geojson",
+    "", "", "", "", "\"", '\\', 0, false, false, false, json_classify
+};
+static const LanguageRules yaml_rules = {
+    "YAML", "yaml yml",
+    "#", "", "", "", "\"'", '\\', '%', false, true, true, yaml_classify
+};
+static const LanguageRules plain_rules = {
+    "Plain Text", "txt text log out csv tsv md",
+    "", "", "", "", "", 0, 0, false, false, false, nullptr
+};
+
+// Files of unknown type larger than this are not worth lexing as C++ on a guess
+static const long long PLAIN_ABOVE = 8 << 20;
+
+// --- Compilation ---
+
+Language::Language(const LanguageRules &rules, bool plain) : rules_(rules), plain_(plain) {
+    memset(stop_, 0, sizeof(stop_));
+    memset(quote_, 0, sizeof(quote_));
+    for (const char *q = rules.quotes; *q; q++) quote_[(unsigned char)*q] = true;
+
+    auto add = [this](int row, char c) {
+        if (!c || stop_[row][(unsigned char)c]) return;
+        stop_[row][(unsigned char)c] = true;
+        Stops &s = sets_[row];
+        if (s.count < (int)sizeof(s.chars)) s.chars[s.count++] = c;
+    };
+    // Plain text: words (to classify them), and the first byte of anything that opens
+    sets_[0].words = true;
+    for (int c = 0; c < 256; c++) {
+        if (isalnum(c) || c == '_' || c >= 0x80) stop_[0][c] = true;
+    }
+    add(0, rules.line_comment[0]);
+    add(0, rules.block_open[0]);
+    add(0, rules.block_alt[0]);
+    add(0, rules.escape);
+    add(0, rules.directive);
+    for (const char *q = rules.quotes; *q; q++) add(0, *q);
+    // Line comments and directives: the newline
+    add(1, '\n');
+    // Block comments: the first byte of the closing delimiter
+    add(2, rules.block_close[0]);
+    // Strings: escapes, quotes, and newlines if they end strings
+    add(3, rules.escape);
+    for (const char *q = rules.quotes; *q; q++) add(3, *q);
+    if (!rules.multiline_strings) add(3, '\n');
+    // Block comments of the second kind: the first byte of their delimiter
+    add(4, rules.block_alt[0]);
+    // Any other state is stepped through byte by byte
+    memset(stop_[5], 1, sizeof(stop_[5]));
+    sets_[5].words = true;
+}
+
+// --- Registry ---
+
+const Language *const *Language::all() {
+    static const Language *const list[] = {
+        &Language::cpp(), &Language::plain(),
+        new Language(python_rules), new Language(json_rules), new Language(yaml_rules), nullptr
+    };
+    return list;
+}
+
+const Language &Language::cpp() {
+    static const Language &language = *new Language(cpp_rules);
+    return language;
+}
+
+const Language &Language::plain() {
+    static const Language &language = *new Language(plain_rules, true);
+    return language;
+}
+
+const Language &Language::of(const LanguageRules &rules) {
+    const Language *const *l = all();
+    while (&(*l)->rules_ != &rules) l++;
+    return **l;
+}
+
+// True if the space separated 'list' holds 'word' (compared without case)
+static bool in_list(const char *list, const char *word) {
+    size_t len = strlen(word);
+    for (const char *p = list; *p; ) {
+        const char *end = strchr(p, ' ');
+        if (!end) end = p + strlen(p);
+        if ((size_t)(end - p) == len) {
+            size_t i = 0;
+            while (i < len && tolower((unsigned char)p[i]) == tolower((unsigned char)word[i])) i++;
+            if (i == len) return true;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return false;
+}
+
+const Language *Language::for_path(const char *path) {
+    if (!path || !*path) return nullptr;
+    const char *base = strrchr(path, '/');
+#ifdef _WIN32
+    const char *backslash = strrchr(path, '\\');
+    if (backslash > base) base = backslash;
+#endif
+    base = base ? base + 1 : path;
+    const char *dot = strrchr(base, '.');
+    if (!dot || dot == base) return nullptr; // No extension, or a dot file
+    for (const Language *const *l = all(); *l; l++) {
+        if (in_list((*l)->rules_.extensions, dot + 1)) return *l;
+    }
+    return nullptr;
+}
+
+// True if 'text' (of 'len' bytes) starts with 'prefix'
+static bool starts_with(const char *text, int len, const char *prefix) {
+    int n = (int)strlen(prefix);
+    return len >= n && memcmp(text, prefix, n) == 0;
+}
+
+const Language &Language::detect(const char *head, int len, long long size) {
+    const char *nl = (const char *)memchr(head, '\n', len);
+    int first_line = nl ? (int)(nl - head) : len;
+    if (starts_with(head, len, "#!")) {
+        for (int i = 2; i + 6 <= first_line; i++) {
+            if (memcmp(head + i, "python", 6) == 0) return of(python_rules);
+        }
+    }
+    if (starts_with(head, len, "%YAML") || starts_with(head, len, "---\n") || starts_with(head, len, "---\r\n"))
+        return of(yaml_rules);
+    int i = 0;
+    while (i < len && isspace((unsigned char)head[i])) i++;
+    if (i < len && (head[i] == '{' || head[i] == '[')) return of(json_rules);
+    static const char *const c_starts[] = { "#include", "#pragma", "#ifndef", "#ifdef", "#if ", "#define", "//", "/*" };
+    for (const char *prefix : c_starts) {
+        if (starts_with(head + i, len - i, prefix)) return cpp();
+    }
+    return size > PLAIN_ABOVE ? plain() : cpp();
+}
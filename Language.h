@@ -0,0 +1,75 @@
+#ifndef LANGUAGE_H
+#define LANGUAGE_H
+
+// --- Language Definitions ---
+// Each language the highlighter knows is a short table of rules: its comment and string
+// delimiters, an escape character, a directive character and a keyword classifier. The
+// rules are compiled once, on first use, into per-state lookup tables that style_parse()
+// runs as a state machine with the same vectorised skipping for every language. The
+// lexer states are the style characters of styletable: 'A' plain, 'B' line comment,
+// 'C' block comment, 'D' string, 'E' directive, with 'F' and 'G' for words. 'H' is a
+// block comment opened by the second delimiter, styled as 'C'.
+
+struct LanguageRules {
+    const char *name;
+    const char *extensions;   // Space separated, lower case, without the dot
+    const char *line_comment; // Starts a comment running to the end of the line ("" for none)
+    const char *block_open;   // Block comment delimiters ("" for none)
+    const char *block_close;
+    const char *block_alt;    // A second block comment delimiter, also closing it ("" for none)
+    const char *quotes;       // Characters that open a string; the same character closes it
+    char escape;              // Inside a string, takes the next character along (0 for none)
+    char directive;           // At column 0, starts a directive running to the end of the line
+    bool multiline_strings;   // Strings carry over newlines (then 'quotes' holds one character)
+    bool colon_keys;          // A word directly followed by ':' is a key, styled 'F'
+    bool value_quotes;        // Quotes open strings only where a value starts: at a line
+                              // start or after ':', '-', ',', '[', '{' or '?' (and blanks)
+    char (*classify)(const char *word, int len); // 'F', 'G' or 0 (nullptr: no keywords)
+};
+
+class Language {
+public:
+    // Bytes that end a run of unchanged state, for the lexer's scalar and vector paths
+    struct Stops {
+        char chars[8];
+        int count = 0;
+        bool words = false; // Identifier characters and bytes >= 0x80 stop too
+    };
+
+    static const Language &cpp();   // C and C++: new documents and small files of unknown type
+    static const Language &plain(); // No lexing at all: every byte is styled 'A'
+    // The language of a file name's extension, or nullptr if it has none we know
+    static const Language *for_path(const char *path);
+    // Guesses from the first bytes of a file of 'size' bytes whose extension said nothing
+    static const Language &detect(const char *head, int len, long long size);
+
+    const LanguageRules &rules() const { return rules_; }
+    const char *name() const { return rules_.name; }
+    bool is_plain() const { return plain_; }
+    bool stops(char state, char c) const { return stop_[slot(state)][(unsigned char)c]; }
+    const Stops &stop_set(char state) const { return sets_[slot(state)]; }
+    bool is_quote(char c) const { return quote_[(unsigned char)c]; }
+
+private:
+    explicit Language(const LanguageRules &rules, bool plain = false);
+    static const Language *const *all(); // Every language, nullptr terminated
+    static const Language &of(const LanguageRules &rules);
+    static int slot(char state) { // Table row of a lexer state; 5 stops at every byte
+        switch (state) {
+            case 'A': return 0;
+            case 'B': case 'E': return 1;
+            case 'C': return 2;
+            case 'D': return 3;
+            case 'H': return 4;
+            default: return 5;
+        }
+    }
+
+    const LanguageRules &rules_;
+    bool plain_;
+    bool stop_[6][256];
+    Stops sets_[6];
+    bool quote_[256];
+};
+
+#endif // LANGUAGE_H
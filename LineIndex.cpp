@@ -0,0 +1,204 @@
+#include "LineIndex.h"
+#include "PieceTable.h"
+
+#include <cstring> // For memchr
+
+// --- Fenwick Trees ---
+
+static int prefix(const std::vector<int> &tree, int block) { // Total of blocks [0, block)
+    int sum = 0;
+    for (int i = block; i > 0; i -= i & -i) sum += tree[i];
+    return sum;
+}
+
+// Block whose range holds 'target' (the last block with a prefix total <= target);
+// *before gets that prefix total
+static int descend(const std::vector<int> &tree, int target, int *before) {
+    int n = (int)tree.size() - 1;
+    int step = 1;
+    while (step * 2 <= n) step *= 2;
+    int idx = 0, acc = 0;
+    for (; step > 0; step /= 2) {
+        if (idx + step <= n && acc + tree[idx + step] <= target) {
+            idx += step;
+            acc += tree[idx];
+        }
+    }
+    *before = acc;
+    return idx;
+}
+
+void LineIndex::add(int block, int bytes, int lines) {
+    for (int i = block + 1; i < (int)tree_bytes_.size(); i += i & -i) {
+        tree_bytes_[i] += bytes;
+        tree_lines_[i] += lines;
+    }
+}
+
+void LineIndex::rebuild() {
+    int n = (int)blocks_.size();
+    tree_bytes_.assign(n + 1, 0);
+    tree_lines_.assign(n + 1, 0);
+    for (int i = 1; i <= n; i++) { // Linear construction: each node passes its total to its parent
+        tree_bytes_[i] += blocks_[i - 1].bytes;
+        tree_lines_[i] += (int)blocks_[i - 1].len.size();
+        int parent = i + (i & -i);
+        if (parent <= n) {
+            tree_bytes_[parent] += tree_bytes_[i];
+            tree_lines_[parent] += tree_lines_[i];
+        }
+    }
+}
+
+// --- Lookups ---
+
+int LineIndex::locate_line(int line, int *block_line, int *block_pos) const {
+    int b = descend(tree_lines_, line, block_line);
+    if (b >= (int)blocks_.size()) b = (int)blocks_.size() - 1; // Cannot happen for line < lines_
+    *block_pos = prefix(tree_bytes_, b);
+    return b;
+}
+
+int LineIndex::locate_pos(int pos, int *block_line, int *block_pos) const {
+    int b = descend(tree_bytes_, pos, block_pos);
+    if (b >= (int)blocks_.size()) b = (int)blocks_.size() - 1;
+    *block_line = prefix(tree_lines_, b);
+    return b;
+}
+
+int LineIndex::line_of(int pos) const {
+    if (pos >= bytes_) return lines_ - 1;
+    if (pos < 0) pos = 0;
+    int bl, bp;
+    const std::vector<int> &len = blocks_[locate_pos(pos, &bl, &bp)].len;
+    int r = pos - bp, i = 0;
+    while (r >= len[i]) r -= len[i++];
+    return bl + i;
+}
+
+int LineIndex::line_start(int line) const {
+    if (line >= lines_) return bytes_;
+    if (line < 0) line = 0;
+    int bl, bp;
+    const std::vector<int> &len = blocks_[locate_line(line, &bl, &bp)].len;
+    for (int i = 0; i < line - bl; i++) bp += len[i];
+    return bp;
+}
+
+int LineIndex::line_end(int line) const {
+    if (line >= lines_ - 1) return bytes_;
+    if (line < 0) line = 0;
+    int bl, bp;
+    const std::vector<int> &len = blocks_[locate_line(line, &bl, &bp)].len;
+    for (int i = 0; i < line - bl; i++) bp += len[i];
+    return bp + len[line - bl] - 1;
+}
+
+// --- Edits ---
+
+void LineIndex::clear() {
+    blocks_.assign(1, Block());
+    blocks_[0].len.assign(1, 0);
+    bytes_ = 0;
+    lines_ = 1;
+    rebuild();
+}
+
+void LineIndex::update(int pos, int nInserted, int nDeleted, const PieceTable &doc) {
+    if (nInserted <= 0 && nDeleted <= 0) return;
+    // Before the edit, lines first..last hold [pos, pos + nDeleted]; they become the lines
+    // made of their text before pos, the inserted text and their text after the deletion
+    int first = line_of(pos);
+    int last = nDeleted > 0 ? line_of(pos + nDeleted) : first;
+    int first_start = line_start(first);
+    int head = pos - first_start;
+    int tail = (last == first ? first_start : line_start(last)) - pos - nDeleted;
+    {
+        int bl, bp;
+        int lb = locate_line(last, &bl, &bp);
+        tail += blocks_[lb].len[last - bl];
+    }
+
+    scratch_.clear();
+    int seg = head;
+    doc.for_each_chunk(pos, pos + nInserted, [&](const char *chunk, int n) {
+        const char *p = chunk, *end = chunk + n;
+        while (const char *nl = (const char *)memchr(p, '\n', end - p)) {
+            seg += (int)(nl - p) + 1;
+            scratch_.push_back(seg);
+            seg = 0;
+            p = nl + 1;
+        }
+        seg += (int)(end - p);
+    });
+    scratch_.push_back(seg + tail);
+
+    if (first == last && scratch_.size() == 1) { // Typing within a line
+        int bl, bp;
+        int b = locate_line(first, &bl, &bp);
+        int delta = nInserted - nDeleted;
+        blocks_[b].len[first - bl] += delta;
+        blocks_[b].bytes += delta;
+        bytes_ += delta;
+        add(b, delta, 0);
+        return;
+    }
+    splice(first, last - first + 1, scratch_);
+}
+
+void LineIndex::splice(int line, int count, const std::vector<int> &repl) {
+    int bl, bp;
+    int b = locate_line(line, &bl, &bp);
+    int i = line - bl;
+    int added = 0;
+    for (int len : repl) added += len;
+
+    // Within one block that stays a reasonable size: adjust it in place
+    Block &blk = blocks_[b];
+    int size = (int)blk.len.size() - count + (int)repl.size();
+    if (i + count <= (int)blk.len.size() && size <= BLOCK_MAX && (size >= BLOCK_FILL / 8 || blocks_.size() == 1)) {
+        int removed = 0;
+        for (int k = i; k < i + count; k++) removed += blk.len[k];
+        blk.len.erase(blk.len.begin() + i, blk.len.begin() + i + count);
+        blk.len.insert(blk.len.begin() + i, repl.begin(), repl.end());
+        blk.bytes += added - removed;
+        bytes_ += added - removed;
+        lines_ += (int)repl.size() - count;
+        add(b, added - removed, (int)repl.size() - count);
+        return;
+    }
+
+    // Otherwise gather the lines of the blocks involved (and a neighbour, if that leaves
+    // too few for a block of their own) and cut them into new blocks
+    int e = b, skip = i + count; // Lines of blocks b..e to drop, counted from the start of b
+    while (skip > (int)blocks_[e].len.size()) skip -= (int)blocks_[e++].len.size();
+    std::vector<int> merged(blk.len.begin(), blk.len.begin() + i);
+    merged.insert(merged.end(), repl.begin(), repl.end());
+    merged.insert(merged.end(), blocks_[e].len.begin() + skip, blocks_[e].len.end());
+    if ((int)merged.size() < BLOCK_FILL / 2) {
+        if (e + 1 < (int)blocks_.size()) {
+            e++;
+            merged.insert(merged.end(), blocks_[e].len.begin(), blocks_[e].len.end());
+        } else if (b > 0) {
+            b--;
+            merged.insert(merged.begin(), blocks_[b].len.begin(), blocks_[b].len.end());
+        }
+    }
+
+    std::vector<Block> cut;
+    for (size_t at = 0; at < merged.size(); at += BLOCK_FILL) {
+        size_t end = at + BLOCK_FILL < merged.size() ? at + BLOCK_FILL : merged.size();
+        cut.emplace_back();
+        cut.back().len.assign(merged.begin() + at, merged.begin() + end);
+        for (size_t k = at; k < end; k++) cut.back().bytes += merged[k];
+    }
+    blocks_.erase(blocks_.begin() + b, blocks_.begin() + e + 1);
+    blocks_.insert(blocks_.begin() + b, cut.begin(), cut.end());
+
+    bytes_ = lines_ = 0;
+    for (const Block &k : blocks_) {
+        bytes_ += k.bytes;
+        lines_ += (int)k.len.size();
+    }
+    rebuild();
+}
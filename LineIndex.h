@@ -0,0 +1,51 @@
+#ifndef LINEINDEX_H
+#define LINEINDEX_H
+
+#include <vector>
+
+class PieceTable;
+
+// --- Line Index ---
+// The length of every line (its '\n' included; the last line has none) kept in blocks of
+// a few hundred lines, with a Fenwick tree over the blocks' byte and line totals. Finding
+// the line of a position, or the start of a line, is a Fenwick descent to the block plus
+// a short walk inside it; an edit within one line adjusts one length and one tree path.
+// Only edits that add or remove lines touch more, and only in proportion to those lines.
+// Lines are numbered from 0.
+class LineIndex {
+public:
+    LineIndex() { clear(); }
+
+    void clear(); // Back to an empty document (one empty line)
+    // Called after the edit is in 'doc' (the inserted bytes are read from there)
+    void update(int pos, int nInserted, int nDeleted, const PieceTable &doc);
+
+    int lines() const { return lines_; }
+    int length() const { return bytes_; }
+    int line_of(int pos) const;       // Line containing 'pos' (the last line for pos >= length())
+    int line_start(int line) const;   // Position of the first byte of 'line' (clamped to the document)
+    int line_end(int line) const;     // Position of the '\n' ending 'line', or length() for the last line
+
+private:
+    static const int BLOCK_MAX = 1024;  // Lines per block before it is split
+    static const int BLOCK_FILL = 512;  // Lines per block after a split or a bulk insert
+
+    struct Block {
+        std::vector<int> len; // Line lengths
+        int bytes = 0;
+    };
+
+    // Replaces 'count' lines from 'line' on by the lengths in 'repl'
+    void splice(int line, int count, const std::vector<int> &repl);
+    int locate_line(int line, int *block_line, int *block_pos) const; // Block holding 'line'
+    int locate_pos(int pos, int *block_line, int *block_pos) const;   // Block holding 'pos'
+    void add(int block, int bytes, int lines);                         // Fenwick point update
+    void rebuild();                                                    // Fenwick trees from the blocks
+
+    std::vector<Block> blocks_;
+    std::vector<int> tree_bytes_, tree_lines_; // Fenwick trees over the blocks (1-based)
+    int bytes_ = 0, lines_ = 0;
+    std::vector<int> scratch_; // Lengths of the lines an edit produces
+};
+
+#endif // LINEINDEX_H
@@ -0,0 +1,139 @@
+#include "MappedFile.h"
+
+#include <cerrno>
+#ifndef _WIN32
+#include <atomic>
+#include <cstdint>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+#ifndef _WIN32
+
+// --- Truncation Guard ---
+// Reading a mapped page past the end of a file another program has cut short raises
+// SIGBUS. Faults inside a mapped file are caught, and the page is replaced by one of
+// zeros, so the document reads '\0's there until it is reloaded or detached instead of
+// the editor crashing. Ranges live in fixed slots the handler can scan without locking.
+
+namespace {
+struct GuardSlot {
+    std::atomic<uintptr_t> start{0}; // 0: free, or being claimed
+    std::atomic<uintptr_t> end{0};   // Non-zero: claimed
+};
+
+const int GUARD_SLOTS = 256;         // Mappings beyond this many go unguarded
+GuardSlot guard_slots[GUARD_SLOTS];
+size_t guard_page;
+struct sigaction guard_previous;
+}
+
+static void guard_handler(int sig, siginfo_t *info, void *context) {
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    for (GuardSlot &s : guard_slots) {
+        uintptr_t start = s.start.load();
+        if (start == 0 || addr < start || addr >= s.end.load()) continue;
+        void *page = (void *)(addr & ~(uintptr_t)(guard_page - 1));
+        if (mmap(page, guard_page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) return;
+        break;
+    }
+    // Not a truncated file: let whatever handled it before do so when the access faults again
+    if (guard_previous.sa_flags & SA_SIGINFO) {
+        guard_previous.sa_sigaction(sig, info, context);
+        return;
+    }
+    sigaction(SIGBUS, &guard_previous, nullptr);
+}
+
+static bool guard_install() {
+    guard_page = (size_t)sysconf(_SC_PAGESIZE);
+    struct sigaction sa = {};
+    sa.sa_sigaction = guard_handler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(SIGBUS, &sa, &guard_previous) == 0;
+}
+
+static int guard_add(const void *p, size_t len) {
+    static bool installed = guard_install();
+    if (!installed) return -1;
+    for (int i = 0; i < GUARD_SLOTS; i++) {
+        uintptr_t none = 0;
+        if (!guard_slots[i].end.compare_exchange_strong(none, (uintptr_t)p + len)) continue;
+        guard_slots[i].start.store((uintptr_t)p);
+        return i;
+    }
+    return -1;
+}
+
+static void guard_remove(int slot) {
+    if (slot < 0) return;
+    guard_slots[slot].start.store(0);
+    guard_slots[slot].end.store(0);
+}
+
+// --- Mapping ---
+
+std::shared_ptr<MappedFile> MappedFile::open(const char *path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    int err = 0;
+    if (fstat(fd, &st) != 0) err = errno;
+    else if (!S_ISREG(st.st_mode)) err = EINVAL;     // Pipes, devices: read them instead
+    else if (st.st_size >= INT_MAX) err = EFBIG;     // Buffer positions are ints
+    if (err) {
+        ::close(fd);
+        errno = err;
+        return nullptr;
+    }
+
+    std::shared_ptr<MappedFile> file(new MappedFile);
+    file->size = (int)st.st_size;
+    if (file->size == 0) {
+        file->data = "";
+        ::close(fd);
+        return file;
+    }
+
+    // Reserve one byte more than the file, zero filled, then map the file over the front.
+    // The kernel zero-fills the tail of the last file page, and when the file ends exactly
+    // on a page boundary the terminator comes from the anonymous reservation.
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    file->map_len_ = ((size_t)file->size + 1 + page - 1) / page * page;
+    void *base = mmap(nullptr, file->map_len_, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) { ::close(fd); return nullptr; }
+    file->map_ = base;
+    if (mmap(base, (size_t)file->size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        err = errno;
+        ::close(fd);
+        errno = err;
+        return nullptr; // Destructor unmaps the reservation
+    }
+    ::close(fd); // The mapping keeps its own reference to the file
+    madvise(base, (size_t)file->size, MADV_SEQUENTIAL);
+    file->guard_ = guard_add(base, (size_t)file->size);
+    file->data = (const char *)base;
+    return file;
+}
+
+MappedFile::~MappedFile() {
+    guard_remove(guard_);
+    if (map_) munmap(map_, map_len_);
+}
+
+#else // No mapping support; callers fall back to reading the file
+
+std::shared_ptr<MappedFile> MappedFile::open(const char *) {
+    errno = ENOSYS;
+    return nullptr;
+}
+
+MappedFile::~MappedFile() {}
+
+#endif
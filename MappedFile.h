@@ -0,0 +1,25 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "PieceTable.h" // MappedFile is a piece source
+#include <memory>
+
+// --- Read-Only File Mapping ---
+// Maps a whole file read-only so it can back the document without a heap copy.
+// Pages are faulted in by the kernel as they are touched. The mapping is always
+// followed by a '\0' byte, so data can be handed to APIs expecting C strings.
+// If the file is cut short while mapped, the lost part reads as '\0's.
+class MappedFile : public PieceSource {
+public:
+    // Returns nullptr (with errno set) if the file cannot be mapped
+    static std::shared_ptr<MappedFile> open(const char *path);
+    ~MappedFile();
+
+private:
+    MappedFile() {}
+    void *map_ = nullptr;
+    size_t map_len_ = 0;
+    int guard_ = -1; // Truncation guard slot, or -1
+};
+
+#endif // MAPPEDFILE_H
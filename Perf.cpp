@@ -0,0 +1,177 @@
+#include "Perf.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// --- Per-Thread Event Rings ---
+// Each ring has a single writer, its thread. Fields are relaxed atomics and 'head' is
+// published with release, so a reader sees whole events; entries the writer may have
+// lapped while they were being copied are dropped after re-reading 'head'.
+
+static const char *const probe_names[PERF_PROBE_COUNT] = {
+    "style_update", "style_parse", "changed_cb", "document_update", "journal_update",
+    "recovery_update", "line_index_update", "redisplay", "draw", "load_file", "save_file", "find", "replace_all", "find_all"
+};
+
+namespace {
+struct Event {
+    std::atomic<long long> start{0}, duration{0}, bytes{0};
+    std::atomic<int> probe{0};
+};
+
+struct Ring {
+    static const unsigned SIZE = 2048;
+    int tid = 0;
+    std::atomic<unsigned long long> head{0}; // Number of events ever written
+    Event events[SIZE];
+};
+
+struct Sample {
+    int probe, tid;
+    long long start, duration, bytes;
+};
+}
+
+static std::mutex &rings_mutex = *new std::mutex;
+static std::vector<Ring *> &rings = *new std::vector<Ring *>;      // Every ring ever made
+static std::vector<Ring *> &free_rings = *new std::vector<Ring *>; // Rings of exited threads
+
+// Hands a thread's ring on to the next new thread when it exits
+struct RingOwner {
+    Ring *ring = nullptr;
+    ~RingOwner() {
+        if (!ring) return;
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        free_rings.push_back(ring);
+    }
+};
+
+static Ring *this_ring() {
+    thread_local RingOwner owner;
+    if (!owner.ring) {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        if (!free_rings.empty()) {
+            owner.ring = free_rings.back();
+            free_rings.pop_back();
+        } else {
+            owner.ring = new Ring;
+            owner.ring->tid = (int)rings.size() + 1;
+            rings.push_back(owner.ring);
+        }
+    }
+    return owner.ring;
+}
+
+void perf_record(PerfProbe probe, long long start_ns, long long duration_ns, long long bytes) {
+    Ring *r = this_ring();
+    unsigned long long h = r->head.load(std::memory_order_relaxed);
+    Event &e = r->events[h % Ring::SIZE];
+    e.start.store(start_ns, std::memory_order_relaxed);
+    e.duration.store(duration_ns, std::memory_order_relaxed);
+    e.bytes.store(bytes, std::memory_order_relaxed);
+    e.probe.store(probe, std::memory_order_relaxed);
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+// Copies the events still held in every ring, or only those of 'probe' if it is >= 0
+static std::vector<Sample> collect(int probe) {
+    std::vector<Ring *> all;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        all = rings;
+    }
+    std::vector<Sample> out;
+    for (Ring *r : all) {
+        unsigned long long head = r->head.load(std::memory_order_acquire);
+        unsigned long long first = head > Ring::SIZE ? head - Ring::SIZE : 0;
+        size_t mark = out.size();
+        std::vector<unsigned long long> index;
+        for (unsigned long long i = first; i < head; i++) {
+            const Event &e = r->events[i % Ring::SIZE];
+            int p = e.probe.load(std::memory_order_relaxed);
+            if (probe >= 0 && p != probe) continue;
+            out.push_back(Sample{ p, r->tid, e.start.load(std::memory_order_relaxed),
+                                  e.duration.load(std::memory_order_relaxed),
+                                  e.bytes.load(std::memory_order_relaxed) });
+            index.push_back(i);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        unsigned long long now = r->head.load(std::memory_order_relaxed);
+        // The writer may be overwriting the slot of event 'now - SIZE' at this moment
+        size_t keep = mark;
+        for (size_t k = 0; k < index.size(); k++) {
+            if (index[k] + Ring::SIZE > now) out[keep++] = out[mark + k];
+        }
+        out.resize(keep);
+    }
+    return out;
+}
+
+// --- Readers ---
+
+PerfStats perf_stats(PerfProbe probe) {
+    PerfStats s = { 0, 0, 0, 0 };
+    std::vector<Sample> samples = collect(probe);
+    if (samples.empty()) return s;
+
+    std::vector<long long> durations;
+    const Sample *last = &samples[0];
+    for (const Sample &e : samples) {
+        durations.push_back(e.duration);
+        if (e.start + e.duration > last->start + last->duration) last = &e;
+    }
+    size_t k = (durations.size() * 99) / 100;
+    if (k >= durations.size()) k = durations.size() - 1;
+    std::nth_element(durations.begin(), durations.begin() + k, durations.end());
+    s.samples = (int)samples.size();
+    s.last_ms = last->duration / 1e6;
+    s.p99_ms = durations[k] / 1e6;
+    s.last_bytes = last->bytes;
+    return s;
+}
+
+std::string perf_summary() {
+    static const struct { PerfProbe probe; const char *label; } shown[] = {
+        { PERF_STYLE_UPDATE, "edit" }, { PERF_CHANGED_CB, "title" }, { PERF_REDISPLAY, "flush" },
+        { PERF_DRAW, "draw" }, { PERF_LOAD_FILE, "load" }, { PERF_SAVE_FILE, "save" },
+        { PERF_FIND, "find" }, { PERF_FIND_ALL, "find all" }, { PERF_REPLACE_ALL, "replace all" }
+    };
+    std::string line;
+    char part[128];
+    for (const auto &p : shown) {
+        PerfStats s = perf_stats(p.probe);
+        if (s.samples == 0) continue;
+        snprintf(part, sizeof(part), "%s%s %.2f / %.2f ms", line.empty() ? "" : "   ", p.label, s.last_ms, s.p99_ms);
+        line += part;
+        if (p.probe == PERF_STYLE_UPDATE) {
+            snprintf(part, sizeof(part), ", relexed %lld B", s.last_bytes);
+            line += part;
+        }
+    }
+    return line.empty() ? "No samples yet (last / p99)" : line + "   (last / p99)";
+}
+
+bool perf_write_trace(const char *path) {
+    std::vector<Sample> samples = collect(-1);
+    std::sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b) { return a.start < b.start; });
+    FILE *fp = fopen(path, "w");
+    if (!fp) return false;
+    long long origin = samples.empty() ? 0 : samples[0].start;
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t i = 0; i < samples.size(); i++) {
+        const Sample &e = samples[i];
+        fprintf(fp, "{\"name\": \"%s\", \"cat\": \"editor\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                    "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"bytes\": %lld}}%s\n",
+                probe_names[e.probe], e.tid, (e.start - origin) / 1e3, e.duration / 1e3, e.bytes,
+                i + 1 < samples.size() ? "," : "");
+    }
+    fprintf(fp, "]}\n");
+    int err = ferror(fp) ? EIO : 0;
+    if (fclose(fp) != 0 && !err) err = errno;
+    if (err) errno = err;
+    return err == 0;
+}
@@ -0,0 +1,69 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <chrono>
+#include <string>
+
+// --- Hot Path Instrumentation ---
+// A PerfScope times the block it lives in and appends one event to the calling thread's
+// own ring buffer (no locks, no allocation once the thread has a ring). Readers on the
+// UI thread copy recent events out of every ring for the status overlay, or write them
+// all as a Chrome trace (chrome://tracing, Perfetto).
+
+enum PerfProbe {
+    PERF_STYLE_UPDATE,    // Modify callback: restyle after an edit (bytes = range re-lexed)
+    PERF_STYLE_PARSE,     // One style_parse() call (bytes = text lexed), any thread
+    PERF_CHANGED_CB,      // Modify callback: changed flag and titles
+    PERF_DOCUMENT_UPDATE, // Modify callback: piece table mirror (bytes = inserted + deleted)
+    PERF_JOURNAL_UPDATE,  // Modify callback: undo journal
+    PERF_RECOVERY_UPDATE, // Modify callback: crash recovery journal (bytes = inserted)
+    PERF_LINE_INDEX_UPDATE, // Modify callback: line index (bytes = inserted + deleted)
+    PERF_REDISPLAY,       // Flush of queued repaints and titles
+    PERF_DRAW,            // FLTK drawing one editor view
+    PERF_LOAD_FILE,       // UI thread share of a load: one chunk applied (bytes = chunk size)
+    PERF_SAVE_FILE,       // bytes = document size
+    PERF_FIND,            // Find Again / Replace Next search
+    PERF_REPLACE_ALL,     // bytes = document size
+    PERF_FIND_ALL,        // bytes = document size
+    PERF_PROBE_COUNT
+};
+
+struct PerfStats {
+    int samples;          // Events of the probe still held in the rings
+    double last_ms;       // Latest event
+    double p99_ms;
+    long long last_bytes; // Bytes processed by the latest event
+};
+
+inline long long perf_now() { // Nanoseconds on the steady clock
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void perf_record(PerfProbe probe, long long start_ns, long long duration_ns, long long bytes);
+
+class PerfScope {
+public:
+    explicit PerfScope(PerfProbe probe, long long bytes = 0) : probe_(probe), bytes_(bytes), start_(perf_now()) {}
+    ~PerfScope() { stop(); }
+    PerfScope(const PerfScope &) = delete;
+    PerfScope &operator=(const PerfScope &) = delete;
+
+    void bytes(long long n) { bytes_ = n; }
+    void stop() { // Records the event now instead of at the end of the scope
+        if (start_ < 0) return;
+        perf_record(probe_, start_, perf_now() - start_, bytes_);
+        start_ = -1;
+    }
+
+private:
+    PerfProbe probe_;
+    long long bytes_;
+    long long start_;
+};
+
+PerfStats perf_stats(PerfProbe probe);
+std::string perf_summary(); // One status line: last / p99 of the main probes
+bool perf_write_trace(const char *path); // Chrome trace-event JSON; false with errno set on failure
+
+#endif // PERF_H
@@ -0,0 +1,275 @@
+#include "PieceTable.h"
+
+#include <cstring> // For memcpy
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// --- Node Pool ---
+// Treap nodes are recycled through a free list instead of going back to the heap;
+// edits allocate a handful of nodes each and snapshots may release them on any thread.
+// Both are deliberately never destroyed, so static destructors (e.g. the global document)
+// can still release nodes at exit. When the list runs dry a slab of nodes is added at
+// once, so a growing tree allocates once per NODE_SLAB nodes rather than once per edit.
+static const int NODE_SLAB = 256;
+static std::mutex &pool_mutex = *new std::mutex;
+static std::vector<PieceNode*> &free_nodes = *new std::vector<PieceNode*>;
+
+static PieceNode *new_node(const std::shared_ptr<const PieceSource> &source, const char *data, int len,
+                           PieceNode *left, PieceNode *right, unsigned priority) {
+    PieceNode *n;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (free_nodes.empty()) {
+            PieceNode *slab = new PieceNode[NODE_SLAB];
+            for (int i = NODE_SLAB - 1; i >= 0; i--) free_nodes.push_back(&slab[i]);
+        }
+        n = free_nodes.back();
+        free_nodes.pop_back();
+    }
+    n->refs.store(1, std::memory_order_relaxed);
+    n->left = left;   // Takes over the caller's references
+    n->right = right;
+    n->source = source;
+    n->data = data;
+    n->len = len;
+    n->total = PieceNode::total_of(left) + len + PieceNode::total_of(right);
+    n->priority = priority;
+    return n;
+}
+
+// Copy of 't' with new children (path copying); 'left'/'right' are owned references
+static PieceNode *clone_with(const PieceNode *t, PieceNode *left, PieceNode *right) {
+    return new_node(t->source, t->data, t->len, left, right, t->priority);
+}
+
+void PieceNode::unref(PieceNode *n) {
+    while (n && n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        unref(n->left);
+        PieceNode *right = n->right;
+        n->source.reset();
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            free_nodes.push_back(n);
+        }
+        n = right; // Release the right spine iteratively
+    }
+}
+
+// --- Persistent Treap Operations ---
+// 't' is borrowed; the returned trees are owned references.
+static std::pair<PieceNode*, PieceNode*> split(const PieceNode *t, int pos) {
+    if (!t) return { nullptr, nullptr };
+    int left_total = PieceNode::total_of(t->left);
+    int piece_end = left_total + t->len;
+
+    if (pos < left_total) {
+        std::pair<PieceNode*, PieceNode*> s = split(t->left, pos);
+        return { s.first, clone_with(t, s.second, PieceNode::ref(t->right)) };
+    }
+    if (pos == left_total) {
+        return { PieceNode::ref(t->left), clone_with(t, nullptr, PieceNode::ref(t->right)) };
+    }
+    if (pos == piece_end) {
+        return { clone_with(t, PieceNode::ref(t->left), nullptr), PieceNode::ref(t->right) };
+    }
+    if (pos > piece_end) {
+        std::pair<PieceNode*, PieceNode*> s = split(t->right, pos - piece_end);
+        return { clone_with(t, PieceNode::ref(t->left), s.first), s.second };
+    }
+    // Split point falls inside this piece: cut it in two (same priority keeps heap order)
+    int off = pos - left_total;
+    PieceNode *l = new_node(t->source, t->data, off, PieceNode::ref(t->left), nullptr, t->priority);
+    PieceNode *r = new_node(t->source, t->data + off, t->len - off, nullptr, PieceNode::ref(t->right), t->priority);
+    return { l, r };
+}
+
+// Both arguments are owned references
+static PieceNode *merge(PieceNode *a, PieceNode *b) {
+    if (!a) return b;
+    if (!b) return a;
+    PieceNode *n;
+    if (a->priority > b->priority) {
+        n = clone_with(a, PieceNode::ref(a->left), merge(PieceNode::ref(a->right), b));
+        PieceNode::unref(a);
+    } else {
+        n = clone_with(b, merge(a, PieceNode::ref(b->left)), PieceNode::ref(b->right));
+        PieceNode::unref(b);
+    }
+    return n;
+}
+
+// Rightmost piece of 't' (borrowed), or nullptr
+static const PieceNode *last_piece(const PieceNode *t) {
+    while (t && t->right) t = t->right;
+    return t;
+}
+
+// Copy of 't' (owned) with its rightmost piece grown by 'n' bytes
+static PieceNode *extend_last(PieceNode *t, int n) {
+    PieceNode *result;
+    if (t->right) {
+        result = clone_with(t, PieceNode::ref(t->left), extend_last(PieceNode::ref(t->right), n));
+    } else {
+        result = new_node(t->source, t->data, t->len + n, PieceNode::ref(t->left), nullptr, t->priority);
+    }
+    PieceNode::unref(t);
+    return result;
+}
+
+// --- Snapshot ---
+
+PieceSnapshot &PieceSnapshot::operator=(const PieceSnapshot &o) {
+    PieceNode *old = root_;
+    root_ = PieceNode::ref(o.root_);
+    PieceNode::unref(old);
+    return *this;
+}
+
+char PieceSnapshot::byte_at(int pos) const {
+    const PieceNode *n = root_;
+    while (n) {
+        int left_total = PieceNode::total_of(n->left);
+        if (pos < left_total) { n = n->left; continue; }
+        pos -= left_total;
+        if (pos < n->len) return n->data[pos];
+        pos -= n->len;
+        n = n->right;
+    }
+    return '\0';
+}
+
+const char *PieceSnapshot::span(int pos, int *len) const {
+    const PieceNode *n = root_;
+    while (n) {
+        int left_total = PieceNode::total_of(n->left);
+        if (pos < left_total) { n = n->left; continue; }
+        pos -= left_total;
+        if (pos < n->len) { *len = n->len - pos; return n->data + pos; }
+        pos -= n->len;
+        n = n->right;
+    }
+    *len = 0;
+    return nullptr;
+}
+
+void PieceSnapshot::copy(int start, int end, char *out) const {
+    for_each_chunk(start, end, [&out](const char *chunk, int n) {
+        memcpy(out, chunk, n);
+        out += n;
+    });
+}
+
+PieceSnapshot PieceSnapshot::slice(int start, int end) const {
+    if (start < 0) start = 0;
+    if (end > length()) end = length();
+    if (start >= end) return PieceSnapshot();
+    std::pair<PieceNode*, PieceNode*> a = split(root_, start);
+    std::pair<PieceNode*, PieceNode*> b = split(a.second, end - start);
+    PieceSnapshot s(b.first);
+    PieceNode::unref(a.first);
+    PieceNode::unref(a.second);
+    PieceNode::unref(b.first);
+    PieceNode::unref(b.second);
+    return s;
+}
+
+// --- Editing ---
+
+namespace {
+// Append-only storage for inserted text; bytes already handed to pieces never change
+struct AddBlock : PieceSource {
+    explicit AddBlock(int capacity) : buf(new char[capacity]) { data = buf.get(); size = capacity; }
+    std::unique_ptr<char[]> buf;
+};
+const int ADD_BLOCK_SIZE = 64 * 1024;
+}
+
+void PieceTable::insert(int pos, const char *text, int len) {
+    if (len <= 0) return;
+    if (pos < 0) pos = 0;
+    if (pos > length()) pos = length();
+
+    // Large inserts get a block of their own; small ones share the current block
+    if (len > ADD_BLOCK_SIZE / 4) {
+        std::shared_ptr<AddBlock> block = std::make_shared<AddBlock>(len);
+        memcpy(block->buf.get(), text, len);
+        std::pair<PieceNode*, PieceNode*> s = split(root_, pos);
+        seed_ ^= seed_ << 13; seed_ ^= seed_ >> 17; seed_ ^= seed_ << 5;
+        PieceNode *piece = new_node(block, block->data, len, nullptr, nullptr, seed_);
+        PieceNode::unref(root_);
+        root_ = merge(merge(s.first, piece), s.second);
+        return;
+    }
+    if (!add_block_ || add_used_ + len > ADD_BLOCK_SIZE) {
+        add_block_ = std::make_shared<AddBlock>(ADD_BLOCK_SIZE);
+        add_used_ = 0;
+    }
+    char *dest = static_cast<AddBlock*>(add_block_.get())->buf.get() + add_used_;
+    memcpy(dest, text, len);
+    add_used_ += len;
+
+    std::pair<PieceNode*, PieceNode*> s = split(root_, pos);
+    PieceNode::unref(root_);
+
+    // Typing appends to the previous piece when it ends right where the new text begins
+    const PieceNode *prev = last_piece(s.first);
+    if (prev && prev->source == add_block_ && prev->data + prev->len == dest) {
+        root_ = merge(extend_last(s.first, len), s.second);
+        return;
+    }
+    seed_ ^= seed_ << 13; seed_ ^= seed_ >> 17; seed_ ^= seed_ << 5;
+    PieceNode *piece = new_node(add_block_, dest, len, nullptr, nullptr, seed_);
+    root_ = merge(merge(s.first, piece), s.second);
+}
+
+void PieceTable::insert(int pos, std::shared_ptr<const PieceSource> source, int offset, int len) {
+    if (len <= 0 || !source) return;
+    if (pos < 0) pos = 0;
+    if (pos > length()) pos = length();
+    const char *data = source->data + offset;
+
+    std::pair<PieceNode*, PieceNode*> s = split(root_, pos);
+    PieceNode::unref(root_);
+
+    // Consecutive ranges of one source (a file read in chunks) grow a single piece
+    const PieceNode *prev = last_piece(s.first);
+    if (prev && prev->source == source && prev->data + prev->len == data) {
+        root_ = merge(extend_last(s.first, len), s.second);
+        return;
+    }
+    seed_ ^= seed_ << 13; seed_ ^= seed_ >> 17; seed_ ^= seed_ << 5;
+    PieceNode *piece = new_node(source, data, len, nullptr, nullptr, seed_);
+    root_ = merge(merge(s.first, piece), s.second);
+}
+
+void PieceTable::remove(int pos, int len) {
+    if (pos < 0) { len += pos; pos = 0; }
+    if (pos + len > length()) len = length() - pos;
+    if (len <= 0) return;
+    std::pair<PieceNode*, PieceNode*> a = split(root_, pos);
+    std::pair<PieceNode*, PieceNode*> b = split(a.second, len);
+    PieceNode::unref(a.second);
+    PieceNode::unref(b.first);
+    PieceNode::unref(root_);
+    root_ = merge(a.first, b.second);
+}
+
+void PieceTable::clear() {
+    PieceNode::unref(root_);
+    root_ = nullptr;
+}
+
+void PieceTable::reset(std::shared_ptr<const PieceSource> source) {
+    clear();
+    if (source && source->size > 0) {
+        root_ = new_node(source, source->data, source->size, nullptr, nullptr, seed_);
+    }
+}
+
+void PieceTable::swap(PieceTable &o) {
+    std::swap(root_, o.root_);
+    add_block_.swap(o.add_block_);
+    std::swap(add_used_, o.add_used_);
+    std::swap(seed_, o.seed_);
+}
@@ -0,0 +1,118 @@
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+
+#include <atomic>
+#include <memory>
+
+// --- Piece Table Document Model ---
+// The document is a sequence of "pieces", each pointing into immutable storage:
+// either the original file contents or append-only blocks that receive typed text.
+// Pieces live in a persistent treap keyed by byte offset, so insert/remove are
+// O(log n) and never move existing text. Nodes are immutable once published and
+// reference counted, which makes a snapshot a single pointer copy that can be read
+// from any thread while the UI keeps editing.
+
+// Immutable byte storage referenced by pieces
+struct PieceSource {
+    virtual ~PieceSource() {}
+    const char *data = nullptr;
+    int size = 0;
+};
+
+// Treap node: one piece plus the byte count of its whole subtree
+struct PieceNode {
+    std::atomic<int> refs;
+    PieceNode *left;
+    PieceNode *right;
+    std::shared_ptr<const PieceSource> source; // Keeps 'data' alive
+    const char *data;
+    int len;
+    int total;
+    unsigned priority;
+
+    static PieceNode *ref(PieceNode *n) { if (n) n->refs.fetch_add(1, std::memory_order_relaxed); return n; }
+    static void unref(PieceNode *n);
+    static int total_of(const PieceNode *n) { return n ? n->total : 0; }
+
+    // Calls f(const char *chunk, int chunk_len) for every piece overlapping [start, end), in order
+    template <class F>
+    static void for_each_chunk(const PieceNode *n, int start, int end, F &f) {
+        while (n && start < end) {
+            int left_total = total_of(n->left);
+            if (start < left_total) for_each_chunk(n->left, start, end, f);
+            int piece_start = left_total, piece_end = left_total + n->len;
+            if (start < piece_end && end > piece_start) {
+                int from = start > piece_start ? start - piece_start : 0;
+                int to = (end < piece_end ? end : piece_end) - piece_start;
+                f(n->data + from, to - from);
+            }
+            // Continue in the right subtree iteratively (keeps recursion depth to the left spine)
+            start -= piece_end; end -= piece_end;
+            if (start < 0) start = 0;
+            n = n->right;
+        }
+    }
+};
+
+// Read-only view of the document at one point in time. Cheap to copy; safe to
+// read from worker threads while the PieceTable it came from keeps changing.
+class PieceSnapshot {
+public:
+    PieceSnapshot() {}
+    explicit PieceSnapshot(PieceNode *root) : root_(PieceNode::ref(root)) {}
+    PieceSnapshot(const PieceSnapshot &o) : root_(PieceNode::ref(o.root_)) {}
+    PieceSnapshot &operator=(const PieceSnapshot &o);
+    ~PieceSnapshot() { PieceNode::unref(root_); }
+
+    int length() const { return PieceNode::total_of(root_); }
+    bool same_as(const PieceSnapshot &o) const { return root_ == o.root_; } // True if no edit lies between them
+    char byte_at(int pos) const;
+    void copy(int start, int end, char *out) const; // Copies [start, end) into 'out' (no terminator)
+    // Contiguous bytes starting at 'pos' without copying; *len receives how many
+    // follow in the same piece. Returns nullptr past the end.
+    const char *span(int pos, int *len) const;
+    // The text [start, end) on its own, sharing the pieces' storage rather than copying it
+    PieceSnapshot slice(int start, int end) const;
+
+    template <class F>
+    void for_each_chunk(int start, int end, F f) const { PieceNode::for_each_chunk(root_, start, end, f); }
+
+private:
+    PieceNode *root_ = nullptr;
+};
+
+// The editable document
+class PieceTable {
+public:
+    PieceTable() {}
+    ~PieceTable() { PieceNode::unref(root_); }
+    PieceTable(const PieceTable &) = delete;
+    PieceTable &operator=(const PieceTable &) = delete;
+
+    int length() const { return PieceNode::total_of(root_); }
+    void insert(int pos, const char *text, int len);
+    // Inserts bytes [offset, offset + len) of 'source' without copying them
+    void insert(int pos, std::shared_ptr<const PieceSource> source, int offset, int len);
+    void remove(int pos, int len);
+    void clear();
+    // Replaces the whole document with 'source' without copying it
+    void reset(std::shared_ptr<const PieceSource> source);
+    void swap(PieceTable &o); // Exchanges the whole contents with 'o' (snapshots of either stay valid)
+
+    PieceSnapshot snapshot() const { return PieceSnapshot(root_); }
+    char byte_at(int pos) const { return snapshot().byte_at(pos); }
+    const char *span(int pos, int *len) const { return snapshot().span(pos, len); }
+    void copy(int start, int end, char *out) const { snapshot().copy(start, end, out); }
+    PieceSnapshot slice(int start, int end) const { return snapshot().slice(start, end); }
+
+    template <class F>
+    void for_each_chunk(int start, int end, F f) const { PieceNode::for_each_chunk(root_, start, end, f); }
+
+private:
+    PieceNode *root_ = nullptr;
+    std::shared_ptr<PieceSource> add_block_; // Current append-only block for inserted text
+    int add_used_ = 0;
+    unsigned seed_ = 0x9e3779b9u;
+};
+
+#endif // PIECETABLE_H
@@ -0,0 +1,449 @@
+#include "Regex.h"
+
+#include <cctype>  // For isalnum, isdigit, isspace, tolower, toupper, isxdigit
+#include <cstdlib> // For strtol
+
+// --- Program Opcodes ---
+enum {
+    OP_CHAR,   // Consume byte 'arg'
+    OP_ANY,    // Consume any byte except '\n'
+    OP_CLASS,  // Consume a byte in classes_[arg]
+    OP_SPLIT,  // Continue at x (preferred) and y
+    OP_JMP,    // Continue at x
+    OP_SAVE,   // Record the position in capture slot 'arg'
+    OP_BOL,    // Assert start of line
+    OP_EOL,    // Assert end of line
+    OP_WORDB,  // Assert word boundary
+    OP_NWORDB, // Assert not a word boundary
+    OP_MATCH
+};
+
+// --- Syntax Tree ---
+struct Regex::Node {
+    enum { LIT, ANY, CLASS, BOL, EOL, WORDB, NWORDB, CAT, ALT, REPEAT, GROUP, EMPTY };
+    int type;
+    int value = 0;          // Byte, class index or group number (-1: non-capturing)
+    int min = 0, max = 0;   // REPEAT bounds, max -1 for unbounded
+    bool greedy = true;
+    std::vector<int> kids;
+};
+
+static inline bool is_word(int c) { return c >= 0 && (isalnum(c) || c == '_'); }
+
+// --- Parser ---
+struct Regex::Parser {
+    Regex &re;
+    const char *p;
+    std::vector<Node> nodes;
+    int groups = 0;
+
+    Parser(Regex &r, const char *pattern) : re(r), p(pattern) {}
+
+    int add(Node n) { nodes.push_back(n); return (int)nodes.size() - 1; }
+    int node(int type, int value = 0) { Node n; n.type = type; n.value = value; return add(n); }
+    bool fail(const char *msg) { if (re.error_.empty()) re.error_ = msg; return false; }
+
+    int new_class() {
+        re.classes_.push_back(std::vector<bool>(256, false));
+        return (int)re.classes_.size() - 1;
+    }
+    void add_range(int cls, int lo, int hi) {
+        for (int c = lo; c <= hi; c++) re.classes_[cls][c] = true;
+    }
+    // Adds \d \w \s (or their negations) to a class; returns false for other letters
+    bool add_shorthand(int cls, char e) {
+        bool neg = isupper((unsigned char)e) != 0;
+        int (*test)(int) = nullptr;
+        switch (tolower((unsigned char)e)) {
+            case 'd': test = isdigit; break;
+            case 's': test = isspace; break;
+            case 'w': test = nullptr; break;
+            default: return false;
+        }
+        for (int c = 0; c < 256; c++) {
+            bool in = test ? test(c) != 0 : is_word(c);
+            if (in != neg) re.classes_[cls][c] = true;
+        }
+        return true;
+    }
+    // Single escaped byte (after the backslash); -1 on error
+    int escaped_byte() {
+        char c = *p++;
+        switch (c) {
+            case 'n': return '\n';
+            case 't': return '\t';
+            case 'r': return '\r';
+            case 'f': return '\f';
+            case 'v': return '\v';
+            case 'x': {
+                if (!isxdigit((unsigned char)p[0]) || !isxdigit((unsigned char)p[1])) { fail("Bad \\x escape"); return -1; }
+                char hex[3] = { p[0], p[1], 0 };
+                p += 2;
+                return (int)strtol(hex, nullptr, 16);
+            }
+            case '\0': p--; fail("Trailing backslash"); return -1;
+            default: return (unsigned char)c;
+        }
+    }
+
+    int parse_alt() {
+        int first = parse_cat();
+        if (*p != '|') return first;
+        Node alt; alt.type = Node::ALT; alt.kids.push_back(first);
+        while (*p == '|') { p++; alt.kids.push_back(parse_cat()); }
+        return add(alt);
+    }
+
+    int parse_cat() {
+        Node cat; cat.type = Node::CAT;
+        while (*p && *p != '|' && *p != ')') {
+            int atom = parse_atom();
+            if (atom < 0) return node(Node::EMPTY);
+            cat.kids.push_back(parse_repeat(atom));
+        }
+        if (cat.kids.size() == 1) return cat.kids[0];
+        return add(cat);
+    }
+
+    int parse_repeat(int atom) {
+        for (;;) {
+            int min, max;
+            if (*p == '*') { min = 0; max = -1; p++; }
+            else if (*p == '+') { min = 1; max = -1; p++; }
+            else if (*p == '?') { min = 0; max = 1; p++; }
+            else if (*p == '{' && isdigit((unsigned char)p[1])) {
+                char *end;
+                min = max = (int)strtol(p + 1, &end, 10);
+                if (*end == ',') {
+                    max = isdigit((unsigned char)end[1]) ? (int)strtol(end + 1, &end, 10) : -1;
+                    if (max < 0 && *end == ',') end++;
+                }
+                if (*end != '}' || (max >= 0 && max < min) || min > 1000 || max > 1000) {
+                    fail("Bad {m,n} repeat");
+                    return atom;
+                }
+                p = end + 1;
+            } else {
+                return atom;
+            }
+            Node rep; rep.type = Node::REPEAT; rep.min = min; rep.max = max;
+            if (*p == '?') { rep.greedy = false; p++; }
+            rep.kids.push_back(atom);
+            atom = add(rep);
+        }
+    }
+
+    int parse_atom() {
+        char c = *p++;
+        switch (c) {
+            case '.': return node(Node::ANY);
+            case '^': return node(Node::BOL);
+            case '$': return node(Node::EOL);
+            case '*': case '+': case '?': fail("Nothing to repeat"); return -1;
+            case '(': {
+                int group = -1;
+                if (p[0] == '?' && p[1] == ':') p += 2;
+                else if (++groups < REGEX_MAX_GROUPS) group = groups;
+                int inner = parse_alt();
+                if (*p != ')') { fail("Missing ')'"); return -1; }
+                p++;
+                Node g; g.type = Node::GROUP; g.value = group; g.kids.push_back(inner);
+                return add(g);
+            }
+            case '[': return parse_class();
+            case '\\': {
+                char e = *p;
+                if (e == 'b') { p++; return node(Node::WORDB); }
+                if (e == 'B') { p++; return node(Node::NWORDB); }
+                int cls = new_class();
+                if (add_shorthand(cls, e)) { p++; return node(Node::CLASS, cls); }
+                re.classes_.pop_back();
+                int b = escaped_byte();
+                return b < 0 ? -1 : node(Node::LIT, b);
+            }
+            default:
+                return node(Node::LIT, (unsigned char)c);
+        }
+    }
+
+    int parse_class() {
+        int cls = new_class();
+        bool negate = false;
+        if (*p == '^') { negate = true; p++; }
+        bool first = true;
+        while (*p && (*p != ']' || first)) {
+            first = false;
+            int lo;
+            if (*p == '\\') {
+                p++;
+                if (add_shorthand(cls, *p)) { p++; continue; }
+                lo = escaped_byte();
+            } else {
+                lo = (unsigned char)*p++;
+            }
+            if (lo < 0) return -1;
+            int hi = lo;
+            if (p[0] == '-' && p[1] && p[1] != ']') {
+                p++;
+                if (*p == '\\') { p++; hi = escaped_byte(); } else hi = (unsigned char)*p++;
+                if (hi < lo) { fail("Bad range in [ ]"); return -1; }
+            }
+            add_range(cls, lo, hi);
+        }
+        if (*p != ']') { fail("Missing ']'"); return -1; }
+        p++;
+        if (!(re.flags_ & SEARCH_MATCH_CASE)) { // Fold before negating: [^a] excludes 'A' too
+            for (int b = 'a'; b <= 'z'; b++) {
+                bool either = re.classes_[cls][b] || re.classes_[cls][toupper(b)];
+                re.classes_[cls][b] = re.classes_[cls][toupper(b)] = either;
+            }
+        }
+        if (negate) {
+            for (int b = 0; b < 256; b++) re.classes_[cls][b] = !re.classes_[cls][b];
+        }
+        return node(Node::CLASS, cls);
+    }
+};
+
+// --- Compiler ---
+
+int Regex::emit(int op, int arg, int x, int y) {
+    prog_.push_back({ op, arg, x, y });
+    return (int)prog_.size() - 1;
+}
+
+// Emits code for node 'n'; returns false (via error_) if the program grows too large
+int Regex::compile(const std::vector<Node> &nodes, int n) {
+    if (prog_.size() > 100000) { error_ = "Pattern too large"; return 0; }
+    const Node &node = nodes[n];
+    bool fold = !(flags_ & SEARCH_MATCH_CASE);
+    switch (node.type) {
+        case Node::LIT:
+            if (fold && isalpha(node.value)) {
+                classes_.push_back(std::vector<bool>(256, false));
+                classes_.back()[tolower(node.value)] = classes_.back()[toupper(node.value)] = true;
+                emit(OP_CLASS, (int)classes_.size() - 1);
+            } else {
+                emit(OP_CHAR, node.value);
+            }
+            break;
+        case Node::ANY: emit(OP_ANY); break;
+        case Node::CLASS: emit(OP_CLASS, node.value); break;
+        case Node::BOL: emit(OP_BOL); break;
+        case Node::EOL: emit(OP_EOL); break;
+        case Node::WORDB: emit(OP_WORDB); break;
+        case Node::NWORDB: emit(OP_NWORDB); break;
+        case Node::EMPTY: break;
+        case Node::CAT:
+            for (int k : node.kids) compile(nodes, k);
+            break;
+        case Node::GROUP:
+            if (node.value >= 0) emit(OP_SAVE, 2 * node.value);
+            compile(nodes, node.kids[0]);
+            if (node.value >= 0) emit(OP_SAVE, 2 * node.value + 1);
+            break;
+        case Node::ALT: {
+            std::vector<int> jumps;
+            for (size_t k = 0; k < node.kids.size(); k++) {
+                if (k + 1 < node.kids.size()) {
+                    int split = emit(OP_SPLIT);
+                    prog_[split].x = split + 1;
+                    compile(nodes, node.kids[k]);
+                    jumps.push_back(emit(OP_JMP));
+                    prog_[split].y = (int)prog_.size();
+                } else {
+                    compile(nodes, node.kids[k]);
+                }
+            }
+            for (int j : jumps) prog_[j].x = (int)prog_.size();
+            break;
+        }
+        case Node::REPEAT: {
+            for (int i = 0; i < node.min; i++) compile(nodes, node.kids[0]);
+            if (node.max < 0) {
+                // L: split body, out; body; jmp L
+                int split = emit(OP_SPLIT);
+                compile(nodes, node.kids[0]);
+                emit(OP_JMP, 0, split);
+                int out = (int)prog_.size();
+                prog_[split].x = node.greedy ? split + 1 : out;
+                prog_[split].y = node.greedy ? out : split + 1;
+            } else {
+                std::vector<int> splits;
+                for (int i = node.min; i < node.max; i++) {
+                    splits.push_back(emit(OP_SPLIT));
+                    compile(nodes, node.kids[0]);
+                }
+                int out = (int)prog_.size();
+                for (int s : splits) {
+                    prog_[s].x = node.greedy ? s + 1 : out;
+                    prog_[s].y = node.greedy ? out : s + 1;
+                }
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
+Regex::Regex(const char *pattern, int flags) : pattern_(pattern ? pattern : ""), flags_(flags) {
+    Parser parser(*this, pattern_.c_str());
+    int root = parser.parse_alt();
+    if (error_.empty() && *parser.p == ')') error_ = "Unmatched ')'";
+    if (!error_.empty()) return;
+
+    // Whole-word mode wraps the pattern in \b ... \b
+    if (flags_ & SEARCH_WHOLE_WORD) emit(OP_WORDB);
+    emit(OP_SAVE, 0);
+    compile(parser.nodes, root);
+    emit(OP_SAVE, 1);
+    if (flags_ & SEARCH_WHOLE_WORD) emit(OP_WORDB);
+    emit(OP_MATCH);
+    if (!error_.empty()) { prog_.clear(); return; }
+
+    // Literal prefix: leading plain characters of a top-level concatenation
+    std::string prefix;
+    const Node &top = parser.nodes[root];
+    if (top.type == Node::LIT) {
+        prefix += (char)top.value;
+    } else if (top.type == Node::CAT) {
+        for (int k : top.kids) {
+            if (parser.nodes[k].type != Node::LIT || parser.nodes[k].value == 0) break;
+            prefix += (char)parser.nodes[k].value;
+        }
+    }
+    if (!prefix.empty()) prefix_.reset(new SearchPattern(prefix.c_str(), flags_ & SEARCH_MATCH_CASE));
+}
+
+// --- Pike VM ---
+
+namespace {
+struct Thread { int pc; int caps; }; // 'caps' indexes a slot array in the owning list
+
+struct ThreadList {
+    std::vector<Thread> threads;
+    std::vector<int> caps; // REGEX_MAX_GROUPS * 2 ints per thread
+    void clear() { threads.clear(); caps.clear(); }
+    void push(int pc, const int *c) {
+        threads.push_back({ pc, (int)caps.size() });
+        caps.insert(caps.end(), c, c + 2 * REGEX_MAX_GROUPS);
+    }
+};
+}
+
+bool Regex::find(const PieceSnapshot &snap, int start, RegexMatch *m, int stop) const {
+    if (prog_.empty() || start < 0) return false;
+    int total = snap.length();
+    if (start > total) return false;
+    if (stop < 0 || stop > total) stop = total + 1; // Allows an empty match at the end
+
+    // Byte access through the current piece; re-spans only when leaving it
+    const char *span_p = nullptr;
+    int span_start = 0, span_len = 0;
+    auto byte = [&](int pos) -> int {
+        if (pos < 0 || pos >= total) return -1;
+        if (pos < span_start || pos >= span_start + span_len) {
+            span_p = snap.span(pos, &span_len);
+            span_start = pos;
+        }
+        return (unsigned char)span_p[pos - span_start];
+    };
+
+    ThreadList pending, current;
+    std::vector<int> visited(prog_.size(), -1);
+    int caps[2 * REGEX_MAX_GROUPS];
+    int best[2 * REGEX_MAX_GROUPS];
+    bool found = false;
+    int prev = byte(start - 1), cur;
+
+    // Follows jumps, splits, saves and assertions from 'pc' at 'pos' in priority order,
+    // adding the consuming (or matching) instructions reached to 'current'
+    struct Closure {
+        const Regex &re; ThreadList &out; std::vector<int> &visited; int step; int pos; int prev; int cur;
+        void add(int pc, int *c) {
+            if (visited[pc] == step) return;
+            visited[pc] = step;
+            const Inst &in = re.prog_[pc];
+            switch (in.op) {
+                case OP_JMP: add(in.x, c); break;
+                case OP_SPLIT: add(in.x, c); add(in.y, c); break;
+                case OP_SAVE: { int old = c[in.arg]; c[in.arg] = pos; add(pc + 1, c); c[in.arg] = old; break; }
+                case OP_BOL: if (prev < 0 || prev == '\n') add(pc + 1, c); break;
+                case OP_EOL: if (cur < 0 || cur == '\n') add(pc + 1, c); break;
+                case OP_WORDB: if (is_word(prev) != is_word(cur)) add(pc + 1, c); break;
+                case OP_NWORDB: if (is_word(prev) == is_word(cur)) add(pc + 1, c); break;
+                default: out.push(pc, c); break;
+            }
+        }
+    };
+
+    for (int pos = start, step = 0; pos <= total; pos++, step++) {
+        // Nothing alive: give up past "stop", or jump to the next place the literal prefix occurs
+        if (pending.threads.empty() && !found) {
+            if (pos >= stop) return false;
+            if (prefix_) {
+                int next = prefix_->find(snap, pos, stop);
+                if (next < 0) return false;
+                if (next > pos) { pos = next; prev = byte(pos - 1); }
+            }
+        }
+        cur = byte(pos);
+
+        current.clear();
+        Closure closure = { *this, current, visited, step, pos, prev, cur };
+        for (const Thread &t : pending.threads) {
+            int *c = &pending.caps[t.caps];
+            closure.add(t.pc, c);
+        }
+        if (!found && pos < stop) { // New attempt starting here, lowest priority
+            for (int &c : caps) c = -1;
+            closure.add(0, caps);
+        }
+
+        pending.clear();
+        for (const Thread &t : current.threads) {
+            const Inst &in = prog_[t.pc];
+            const int *c = &current.caps[t.caps];
+            if (in.op == OP_MATCH) {
+                found = true;
+                for (int i = 0; i < 2 * REGEX_MAX_GROUPS; i++) best[i] = c[i];
+                break; // Lower-priority threads cannot win any more
+            }
+            bool take = false;
+            if (cur >= 0) {
+                if (in.op == OP_CHAR) take = (cur == in.arg);
+                else if (in.op == OP_ANY) take = (cur != '\n');
+                else if (in.op == OP_CLASS) take = classes_[in.arg][cur];
+            }
+            if (take) pending.push(t.pc + 1, c);
+        }
+        if (pending.threads.empty() && found) break;
+        prev = cur;
+    }
+
+    if (!found) return false;
+    m->start = best[0];
+    m->end = best[1];
+    for (int i = 0; i < 2 * REGEX_MAX_GROUPS; i++) m->groups[i] = best[i];
+    return true;
+}
+
+std::string Regex::expand(const char *replacement, const RegexMatch &m, const PieceSnapshot &snap) {
+    std::string out;
+    for (const char *r = replacement; *r; r++) {
+        if (*r != '\\' || !r[1]) { out += *r; continue; }
+        char c = *++r;
+        if (isdigit((unsigned char)c)) {
+            int g = c - '0';
+            int s = m.groups[2 * g], e = m.groups[2 * g + 1];
+            if (s >= 0 && e >= s) {
+                size_t o = out.size();
+                out.resize(o + (e - s));
+                snap.copy(s, e, &out[o]);
+            }
+        } else if (c == 'n') out += '\n';
+        else if (c == 't') out += '\t';
+        else out += c;
+    }
+    return out;
+}
@@ -0,0 +1,60 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include "PieceTable.h"    // Matching streams over document snapshots
+#include "SearchPattern.h" // Flags and the literal prefix scan
+#include <memory>
+#include <string>
+#include <vector>
+
+// --- Regular Expression Search ---
+// Patterns are compiled once into a small NFA program and run with a Pike VM: all
+// threads advance together one byte at a time, so matching is linear in the text,
+// needs no backtracking, and streams over the document's pieces without copying.
+// A literal prefix, if the pattern has one, is located with SearchPattern first.
+//
+// Syntax: literals, '.', [classes] (ranges, negation, \d \w \s inside), ( ) groups,
+// (?: ) non-capturing groups, '|', * + ? {m} {m,} {m,n} (append '?' for lazy),
+// ^ $ (line anchors), \b \B, \d \D \w \W \s \S, \n \t \r and \xHH escapes.
+// Groups 1-9 are available to replacements as \1..\9 (\0 is the whole match).
+
+enum { REGEX_MAX_GROUPS = 10 };
+
+struct RegexMatch {
+    int start = -1, end = -1;
+    int groups[2 * REGEX_MAX_GROUPS]; // Start/end pairs, -1 when a group did not take part
+};
+
+class Regex {
+public:
+    // 'flags' uses the SEARCH_* values; SEARCH_MATCH_CASE off means case-insensitive
+    Regex(const char *pattern, int flags);
+
+    bool ok() const { return error_.empty(); }
+    const char *error() const { return error_.c_str(); }
+    const std::string &pattern() const { return pattern_; }
+    int flags() const { return flags_; }
+
+    // Leftmost match starting at or after 'start' (and before 'stop' if given).
+    // Returns false if there is none.
+    bool find(const PieceSnapshot &snap, int start, RegexMatch *m, int stop = -1) const;
+    // Replacement text for 'm' with \0..\9, \n, \t and \\ expanded
+    static std::string expand(const char *replacement, const RegexMatch &m, const PieceSnapshot &snap);
+
+private:
+    struct Inst { int op; int arg; int x; int y; };
+    struct Node;
+    struct Parser;
+
+    int compile(const std::vector<Node> &nodes, int n);
+    int emit(int op, int arg = 0, int x = 0, int y = 0);
+
+    std::string pattern_;
+    int flags_;
+    std::string error_;
+    std::vector<Inst> prog_;
+    std::vector<std::vector<bool>> classes_; // 256 entries each
+    std::unique_ptr<SearchPattern> prefix_;  // Literal every match starts with, if any
+};
+
+#endif // REGEX_H
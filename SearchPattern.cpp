@@ -0,0 +1,116 @@
+#include "SearchPattern.h"
+
+#include <cctype>  // For tolower, toupper, isalnum
+#include <cstring> // For memcmp
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static inline unsigned char fold(unsigned char c) { return (unsigned char)tolower(c); }
+
+static inline bool is_word_byte(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+SearchPattern::SearchPattern(const char *text, int flags) : needle_(text ? text : ""), flags_(flags) {
+    if (needle_.empty()) return;
+    unsigned char f = (unsigned char)needle_[0], l = (unsigned char)needle_[needle_.size() - 1];
+    if (flags_ & SEARCH_MATCH_CASE) {
+        first_[0] = first_[1] = f;
+        last_[0] = last_[1] = l;
+    } else {
+        first_[0] = (unsigned char)tolower(f); first_[1] = (unsigned char)toupper(f);
+        last_[0] = (unsigned char)tolower(l);  last_[1] = (unsigned char)toupper(l);
+    }
+}
+
+bool SearchPattern::equal_at(const char *p) const {
+    if (flags_ & SEARCH_MATCH_CASE) return memcmp(p, needle_.data(), needle_.size()) == 0;
+    for (size_t i = 0; i < needle_.size(); i++) {
+        if (fold((unsigned char)p[i]) != fold((unsigned char)needle_[i])) return false;
+    }
+    return true;
+}
+
+bool SearchPattern::whole_word_at(const PieceSnapshot &snap, int pos) const {
+    if (!(flags_ & SEARCH_WHOLE_WORD)) return true;
+    if (pos > 0 && is_word_byte(snap.byte_at(pos - 1))) return false;
+    int end = pos + length();
+    return end >= snap.length() || !is_word_byte(snap.byte_at(end));
+}
+
+// Returns the offset of the first candidate in p[from, limit) whose whole pattern matches;
+// p[limit + length() - 2] must still be readable. Returns -1 if none.
+int SearchPattern::scan(const char *p, int from, int limit) const {
+    int last_off = length() - 1;
+    int i = from;
+#if defined(__AVX2__)
+    const __m256i f0 = _mm256_set1_epi8((char)first_[0]), f1 = _mm256_set1_epi8((char)first_[1]);
+    const __m256i l0 = _mm256_set1_epi8((char)last_[0]), l1 = _mm256_set1_epi8((char)last_[1]);
+    for (; i + 32 <= limit; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + i + last_off));
+        __m256i hit = _mm256_and_si256(_mm256_or_si256(_mm256_cmpeq_epi8(a, f0), _mm256_cmpeq_epi8(a, f1)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(b, l0), _mm256_cmpeq_epi8(b, l1)));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (equal_at(p + i + bit)) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i f0 = _mm_set1_epi8((char)first_[0]), f1 = _mm_set1_epi8((char)first_[1]);
+    const __m128i l0 = _mm_set1_epi8((char)last_[0]), l1 = _mm_set1_epi8((char)last_[1]);
+    for (; i + 16 <= limit; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + i + last_off));
+        __m128i hit = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(a, f0), _mm_cmpeq_epi8(a, f1)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(b, l0), _mm_cmpeq_epi8(b, l1)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        while (mask) {
+            int bit = __builtin_ctz(mask);
+            if (equal_at(p + i + bit)) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < limit; i++) {
+        unsigned char a = (unsigned char)p[i], b = (unsigned char)p[i + last_off];
+        if ((a == first_[0] || a == first_[1]) && (b == last_[0] || b == last_[1]) && equal_at(p + i)) return i;
+    }
+    return -1;
+}
+
+int SearchPattern::find(const PieceSnapshot &snap, int start, int stop) const {
+    int len = length();
+    int total = snap.length();
+    if (len == 0 || start < 0) return -1;
+    if (stop < 0 || stop > total) stop = total;
+    std::vector<char> edge; // Bytes of a candidate that spans two pieces
+
+    for (int pos = start; pos < stop && pos + len <= total; ) {
+        int avail;
+        const char *p = snap.span(pos, &avail);
+        // Candidates lying entirely inside this piece
+        int from = 0;
+        int limit = avail - len + 1;
+        if (limit > stop - pos) limit = stop - pos;
+        while (from < limit) {
+            int i = scan(p, from, limit);
+            if (i < 0) break;
+            if (whole_word_at(snap, pos + i)) return pos + i;
+            from = i + 1;
+        }
+        // Candidates starting near the end of this piece and running into the next ones
+        for (int i = limit > 0 ? limit : 0; i < avail && pos + i < stop && pos + i + len <= total; i++) {
+            unsigned char a = (unsigned char)p[i];
+            if (a != first_[0] && a != first_[1]) continue;
+            edge.resize(len);
+            snap.copy(pos + i, pos + i + len, edge.data());
+            if (equal_at(edge.data()) && whole_word_at(snap, pos + i)) return pos + i;
+        }
+        pos += avail;
+    }
+    return -1;
+}
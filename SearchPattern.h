@@ -0,0 +1,37 @@
+#ifndef SEARCHPATTERN_H
+#define SEARCHPATTERN_H
+
+#include "PieceTable.h" // Searches run over document snapshots
+#include <string>
+
+// --- Search Flags ---
+enum {
+    SEARCH_MATCH_CASE = 1, // Otherwise ASCII letters match regardless of case
+    SEARCH_WHOLE_WORD = 2, // Match must not touch letters, digits or '_' on either side
+    SEARCH_REGEX = 4       // Pattern is a regular expression (see Regex.h)
+};
+
+// --- Literal Substring Search ---
+// Scans the document's pieces directly (no copy, no gap crossing). Candidates are found
+// by comparing the first and last pattern bytes against 16 or 32 text bytes at a time
+// (SSE2/AVX2 where the compiler targets them, scalar otherwise); only candidates that
+// pass both are compared in full. Matches spanning two pieces are handled too.
+class SearchPattern {
+public:
+    SearchPattern(const char *text, int flags);
+
+    int length() const { return (int)needle_.size(); }
+    // Start of the first match at or after 'start' (and before 'stop' if given), or -1
+    int find(const PieceSnapshot &snap, int start, int stop = -1) const;
+
+private:
+    bool equal_at(const char *p) const;   // Full compare of a contiguous candidate
+    bool whole_word_at(const PieceSnapshot &snap, int pos) const;
+    int scan(const char *p, int from, int limit) const; // First verified candidate in [from, limit)
+
+    std::string needle_;
+    int flags_;
+    unsigned char first_[2], last_[2]; // Both cases of the first and last byte
+};
+
+#endif // SEARCHPATTERN_H
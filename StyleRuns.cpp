@@ -0,0 +1,83 @@
+#include "StyleRuns.h"
+
+#include <algorithm> // For upper_bound
+#include <cstring>   // For memset
+
+void StyleRuns::clear() {
+    std::vector<unsigned char>().swap(code_); // Releases the memory, not just the contents
+    std::vector<Checkpoint>().swap(checkpoints_);
+    runs_ = length_ = open_len_ = 0;
+    open_style_ = 0;
+}
+
+void StyleRuns::trim() {
+    code_.shrink_to_fit();
+    checkpoints_.shrink_to_fit();
+}
+
+void StyleRuns::append(const char *styles, int len) {
+    for (int i = 0; i < len; ) {
+        char style = styles[i];
+        int j = i + 1;
+        while (j < len && styles[j] == style) j++;
+        if (style != open_style_) {
+            if (open_len_ > 0) put_run(open_style_, open_len_);
+            open_style_ = style;
+            open_len_ = 0;
+        }
+        open_len_ += j - i;
+        length_ += j - i;
+        i = j;
+    }
+}
+
+// Closes the open run of 'len' styles, which ends at length_
+void StyleRuns::put_run(char style, int len) {
+    if (runs_ % CHECKPOINT == 0) checkpoints_.push_back({ length_ - len, (int)code_.size() });
+    unsigned index = (unsigned char)(style - 'A');
+    if (index > 7) index = 0; // Not a style character: stored as plain
+    if (len < 32) {
+        code_.push_back((unsigned char)(index << 5 | len));
+    } else {
+        code_.push_back((unsigned char)(index << 5));
+        for (; len >= 128; len >>= 7) code_.push_back((unsigned char)(0x80 | (len & 127)));
+        code_.push_back((unsigned char)len);
+    }
+    runs_++;
+}
+
+void StyleRuns::expand(int start, int end, char *out) const {
+    if (end > length_) end = length_;
+    if (start >= end) return;
+    int pos = 0;
+    size_t at = 0;
+    auto after = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), start,
+                                  [](int p, const Checkpoint &c) { return p < c.pos; });
+    if (after != checkpoints_.begin()) { // Last checkpoint at or before 'start'
+        pos = (after - 1)->pos;
+        at = (size_t)(after - 1)->offset;
+    }
+    while (pos < end) {
+        char style;
+        int len;
+        if (at < code_.size()) {
+            unsigned char b = code_[at++];
+            style = (char)('A' + (b >> 5));
+            len = b & 31;
+            if (len == 0) {
+                for (int shift = 0; ; shift += 7) {
+                    unsigned char c = code_[at++];
+                    len |= (c & 127) << shift;
+                    if (!(c & 0x80)) break;
+                }
+            }
+        } else {
+            style = open_style_;
+            len = open_len_;
+        }
+        int from = pos > start ? pos : start;
+        int to = pos + len < end ? pos + len : end;
+        if (from < to) memset(out + (from - start), style, to - from);
+        pos += len;
+    }
+}
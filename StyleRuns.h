@@ -0,0 +1,45 @@
+#ifndef STYLERUNS_H
+#define STYLERUNS_H
+
+#include <cstddef>
+#include <vector>
+
+// --- Run-Length Style Store ---
+// Styles as runs of one style character. Most of a document is long stretches of one
+// style (plain code between keywords, comments, strings), so it takes about a byte per
+// token instead of a byte per character. Each run is one code byte holding the style
+// ('A' to 'H') and a length up to 31; a longer run has length 0 in that byte and its
+// length in the 7-bit groups that follow. Every CHECKPOINT runs the position and code
+// offset are noted, so reading a range decodes only from the checkpoint before it.
+// Styles are appended in order and read back by range. Only parked documents use it: the
+// document being shown keeps its styles in stylebuf, which FLTK's highlighting reads.
+class StyleRuns {
+public:
+    void clear();
+    void append(const char *styles, int len); // Adds styles at the end
+    void expand(int start, int end, char *out) const; // Styles of [start, end) into 'out' (no terminator)
+    void trim(); // Frees the spare capacity left by appending, once everything is in
+
+    int length() const { return length_; }
+    bool empty() const { return length_ == 0; }
+    size_t memory() const { return code_.capacity() + checkpoints_.capacity() * sizeof(Checkpoint); }
+
+private:
+    static const int CHECKPOINT = 64;
+
+    struct Checkpoint {
+        int pos;    // Position of the run's first style
+        int offset; // Offset of its code
+    };
+
+    void put_run(char style, int len);
+
+    std::vector<unsigned char> code_;
+    std::vector<Checkpoint> checkpoints_;
+    int runs_ = 0;    // Runs in code_
+    int length_ = 0;  // Styles held, the open run included
+    char open_style_ = 0; // The last run stays open until a different style is appended
+    int open_len_ = 0;
+};
+
+#endif // STYLERUNS_H
@@ -0,0 +1,24 @@
+#ifndef TEXTBUFFER_H
+#define TEXTBUFFER_H
+
+#include <FL/Fl_Text_Buffer.H>
+#include <climits>
+
+// --- Text Buffer ---
+// FLTK's gap buffer, able to make room in advance. When an insert does not fit in the
+// gap, FLTK moves the whole text into a new buffer with a gap of just the insert plus
+// its preferred gap size (1 KB), so text arriving in many pieces (a file streaming in, a
+// document shown again from its piece table) would be moved once per piece. Reserving
+// the room for all of it first leaves the pieces to be copied in only.
+class TextBuffer : public Fl_Text_Buffer {
+public:
+    // Makes the gap hold at least 'bytes' at 'pos', where the text is about to be
+    // inserted in order
+    void reserve(int pos, int bytes) {
+        int most = INT_MAX - mLength - mPreferredGapSize; // Sizes are ints
+        if (bytes > most) bytes = most;
+        if (bytes > mGapEnd - mGapStart) reallocate_with_gap(pos, bytes + mPreferredGapSize);
+    }
+};
+
+#endif // TEXTBUFFER_H
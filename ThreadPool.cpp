@@ -0,0 +1,74 @@
+#include "ThreadPool.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// --- Pool State ---
+// Leaked on purpose like the piece node pool: workers are detached and may still be
+// waiting on these while static destructors run at exit.
+namespace {
+struct Batch {
+    const std::function<void(int)> *task = nullptr;
+    int count = 0;
+    int next = 0; // Next index to hand out
+    int done = 0; // Indices finished
+};
+std::mutex &pool_mutex = *new std::mutex;
+std::condition_variable &work_ready = *new std::condition_variable;
+std::condition_variable &work_done = *new std::condition_variable;
+std::mutex &batch_mutex = *new std::mutex; // One parallel_for at a time
+Batch batch;
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool &pool = *new ThreadPool;
+    return pool;
+}
+
+ThreadPool::ThreadPool() {
+    int n = (int)std::thread::hardware_concurrency();
+    workers_ = n > 1 ? n - 1 : 0;
+    for (int i = 0; i < workers_; i++) std::thread(&ThreadPool::worker, this).detach();
+}
+
+bool ThreadPool::run_one() {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    if (!batch.task || batch.next >= batch.count) return false;
+    int i = batch.next++;
+    const std::function<void(int)> *task = batch.task;
+    lock.unlock();
+
+    (*task)(i);
+
+    lock.lock();
+    if (++batch.done == batch.count) work_done.notify_all();
+    return true;
+}
+
+void ThreadPool::worker() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            work_ready.wait(lock, [] { return batch.task && batch.next < batch.count; });
+        }
+        run_one();
+    }
+}
+
+void ThreadPool::parallel_for(int count, const std::function<void(int)> &task) {
+    if (count <= 0) return;
+    std::lock_guard<std::mutex> serial(batch_mutex);
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        batch.task = &task;
+        batch.count = count;
+        batch.next = batch.done = 0;
+    }
+    work_ready.notify_all();
+    while (run_one()) {}
+
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    work_done.wait(lock, [] { return batch.done == batch.count; });
+    batch.task = nullptr;
+}
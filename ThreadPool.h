@@ -0,0 +1,26 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <functional>
+
+// --- Thread Pool ---
+// One worker per hardware thread, started on first use and kept for the life of the
+// program. parallel_for() blocks the caller, which works on the batch too, so it can be
+// used straight from a UI callback for short bursts of work (Find All and the like).
+class ThreadPool {
+public:
+    static ThreadPool &shared();
+
+    int size() const { return workers_ + 1; } // Including the calling thread
+    // Runs task(0) .. task(count - 1) across the pool and returns when all have finished
+    void parallel_for(int count, const std::function<void(int)> &task);
+
+private:
+    ThreadPool();
+    void worker();
+    bool run_one(); // Runs the next index of the current batch; false if none is left
+
+    int workers_;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,250 @@
+#include "UndoJournal.h"
+#include "PieceTable.h"
+
+#include <FL/Fl_Text_Buffer.H>
+#include <algorithm> // For std::reverse
+#include <cstring>   // For memcpy
+#include <string>
+
+static const int BLOCK_SIZE = 64 * 1024;
+static const int SHARE_MIN = BLOCK_SIZE / 4; // Inserts above this keep a slice of the document
+
+// --- Arena ---
+
+char *UndoJournal::text(const Record &r) {
+    return blocks_[r.block - first_block_].data.get() + r.offset;
+}
+
+char *UndoJournal::allocate(int len, Record *r) {
+    if (blocks_.empty() || blocks_.back().used + len > blocks_.back().size) {
+        Block b;
+        b.size = len > BLOCK_SIZE / 4 || len == 0 ? len : BLOCK_SIZE; // Big edits get a block of their own
+        b.data.reset(new char[b.size]);
+        b.used = 0;
+        blocks_.push_back(std::move(b));
+        bytes_ += blocks_.back().size;
+    }
+    Block &b = blocks_.back();
+    r->block = first_block_ + blocks_.size() - 1;
+    r->offset = b.used;
+    b.used += len;
+    return b.data.get() + r->offset;
+}
+
+void UndoJournal::append_inserted(const Record &r, std::string *out) {
+    size_t o = out->size();
+    out->resize(o + r.ins);
+    if (r.shared.length()) r.shared.copy(0, r.ins, &(*out)[o]);
+    else memcpy(&(*out)[o], text(r) + r.del, r.ins);
+}
+
+bool UndoJournal::extend(Record &r, int len) {
+    if (r.shared.length() || blocks_.empty() || r.block != first_block_ + blocks_.size() - 1) return false;
+    Block &b = blocks_.back();
+    if (r.offset + r.del + r.ins != b.used || b.used + len > b.size) return false;
+    b.used += len;
+    return true;
+}
+
+// A new edit discards the redo records; their text was the last thing in the arena
+void UndoJournal::truncate_redo() {
+    if (records_.size() <= cursor_) return;
+    bytes_ -= (records_.size() - cursor_) * sizeof(Record);
+    records_.erase(records_.begin() + cursor_, records_.end());
+    if (records_.empty()) {
+        clear();
+        return;
+    }
+    const Record &r = records_.back();
+    while (first_block_ + blocks_.size() - 1 > r.block) {
+        bytes_ -= blocks_.back().size;
+        blocks_.pop_back();
+    }
+    blocks_.back().used = r.offset + arena_len(r);
+}
+
+// Drops the oldest records, and the blocks only they used, until within the limit. A
+// group goes as a whole, or undoing what is left of it would give a text that never was.
+void UndoJournal::evict() {
+    while (bytes_ > limit_ && !records_.empty()) {
+        unsigned group = records_.front().group;
+        if (group && group == group_) return; // Still being recorded: kept, over the limit if need be
+        size_t n = 1;
+        while (group && n < records_.size() && records_[n].group == group) n++;
+        if (n > cursor_) { // Only redo records left; they cannot be replayed out of order
+            clear();
+            return;
+        }
+        records_.erase(records_.begin(), records_.begin() + n);
+        bytes_ -= n * sizeof(Record);
+        cursor_ -= n;
+        size_t keep = records_.empty() ? first_block_ + blocks_.size() : records_.front().block;
+        while (!blocks_.empty() && first_block_ < keep) {
+            bytes_ -= blocks_.front().size;
+            blocks_.pop_front();
+            first_block_++;
+        }
+    }
+}
+
+void UndoJournal::set_limit(size_t bytes) {
+    limit_ = bytes;
+    evict();
+}
+
+void UndoJournal::clear() {
+    records_.clear();
+    cursor_ = 0;
+    first_block_ += blocks_.size();
+    blocks_.clear();
+    bytes_ = 0;
+    coalesce_ = false;
+}
+
+// --- Recording ---
+
+void UndoJournal::begin_group() {
+    if (++next_group_ == 0) next_group_ = 1;
+    group_ = next_group_;
+}
+
+void UndoJournal::end_group() {
+    group_ = 0;
+    coalesce_ = false;
+    evict(); // The group may have gone over the limit while it could not be dropped
+}
+
+void UndoJournal::record(int pos, int nInserted, int nDeleted, const char *deletedText, const PieceTable &doc) {
+    if (replaying_ || (nInserted <= 0 && nDeleted <= 0)) return;
+    if (nDeleted > 0 && !deletedText) { // Cannot be undone; older records no longer line up either
+        clear();
+        return;
+    }
+    truncate_redo();
+
+    // Merge into the previous record where the edit continues it
+    if (coalesce_ && !records_.empty()) {
+        Record &last = records_.back();
+        bool plain_insert = nDeleted == 0 && last.del == 0 && pos == last.pos + last.ins;
+        if (group_ && last.group == group_ && plain_insert && last.shared.length()) {
+            last.ins += nInserted;
+            last.shared = doc.slice(last.pos, last.pos + last.ins);
+            return;
+        }
+        if (group_ && last.group == group_ && plain_insert && extend(last, nInserted)) {
+            doc.copy(pos, pos + nInserted, text(last) + last.ins);
+            last.ins += nInserted;
+            evict();
+            return;
+        }
+        if (!group_ && last.group == 0) {
+            // Typing: one character at a time, a new line starts a new step
+            if (plain_insert && nInserted == 1 && doc.byte_at(pos) != '\n' && extend(last, 1)) {
+                text(last)[last.ins++] = doc.byte_at(pos);
+                return;
+            }
+            if (nInserted == 0 && nDeleted == 1 && last.ins == 0) {
+                // Delete key: same position, text grows forwards
+                if (pos == last.pos && !last.backward && extend(last, 1)) {
+                    text(last)[last.del++] = deletedText[0];
+                    return;
+                }
+                // Backspace: one position back, text is kept last-to-first
+                if (pos == last.pos - 1 && (last.backward || last.del == 1) && extend(last, 1)) {
+                    text(last)[last.del++] = deletedText[0];
+                    last.backward = true;
+                    last.pos = pos;
+                    return;
+                }
+            }
+        }
+    }
+
+    Record r;
+    r.pos = pos;
+    r.ins = nInserted > 0 ? nInserted : 0;
+    r.del = nDeleted > 0 ? nDeleted : 0;
+    r.group = group_;
+    r.backward = false;
+    if (r.ins > SHARE_MIN) r.shared = doc.slice(pos, pos + r.ins);
+    char *t = allocate(arena_len(r), &r);
+    if (r.del) memcpy(t, deletedText, r.del);
+    if (r.ins && !r.shared.length()) doc.copy(pos, pos + r.ins, t + r.del);
+    records_.push_back(r);
+    cursor_ = records_.size();
+    bytes_ += sizeof(Record);
+    coalesce_ = true;
+    evict();
+}
+
+// --- Replay ---
+
+// Undoes (forward = false) or redoes one record as a single buffer operation
+void UndoJournal::apply(Fl_Text_Buffer &buf, const Record &r, bool forward, int *cursor) {
+    std::string deleted(text(r), r.del), inserted;
+    append_inserted(r, &inserted);
+    if (r.backward) std::reverse(deleted.begin(), deleted.end());
+    const std::string &from = forward ? deleted : inserted; // What the buffer holds now
+    const std::string &to = forward ? inserted : deleted;
+
+    replaying_ = true;
+    if (from.empty()) buf.insert(r.pos, to.c_str());
+    else if (to.empty()) buf.remove(r.pos, r.pos + (int)from.size());
+    else buf.replace(r.pos, r.pos + (int)from.size(), to.c_str());
+    replaying_ = false;
+    *cursor = r.pos + (int)to.size();
+}
+
+int UndoJournal::undo(Fl_Text_Buffer &buf) {
+    if (!can_undo()) return -1;
+    int cursor = -1;
+    unsigned group = records_[cursor_ - 1].group;
+    do {
+        const Record &r = records_[--cursor_];
+        if (group && r.del == 0) {
+            // Adjacent inserts of a group (Insert File chunks) come out with one remove
+            int start = r.pos, end = r.pos + r.ins;
+            while (cursor_ > 0) {
+                const Record &prev = records_[cursor_ - 1];
+                if (prev.group != group || prev.del != 0 || prev.pos + prev.ins != start) break;
+                start = prev.pos;
+                cursor_--;
+            }
+            replaying_ = true;
+            buf.remove(start, end);
+            replaying_ = false;
+            cursor = start;
+        } else {
+            apply(buf, r, false, &cursor);
+        }
+    } while (group && cursor_ > 0 && records_[cursor_ - 1].group == group);
+    coalesce_ = false;
+    return cursor;
+}
+
+int UndoJournal::redo(Fl_Text_Buffer &buf) {
+    if (!can_redo()) return -1;
+    int cursor = -1;
+    unsigned group = records_[cursor_].group;
+    do {
+        const Record &r = records_[cursor_++];
+        if (group && r.del == 0) {
+            std::string inserted;
+            append_inserted(r, &inserted);
+            while (cursor_ < records_.size()) {
+                const Record &next = records_[cursor_];
+                if (next.group != group || next.del != 0 || next.pos != r.pos + (int)inserted.size()) break;
+                append_inserted(next, &inserted);
+                cursor_++;
+            }
+            replaying_ = true;
+            buf.insert(r.pos, inserted.c_str());
+            replaying_ = false;
+            cursor = r.pos + (int)inserted.size();
+        } else {
+            apply(buf, r, true, &cursor);
+        }
+    } while (group && cursor_ < records_.size() && records_[cursor_].group == group);
+    coalesce_ = false;
+    return cursor;
+}
@@ -0,0 +1,86 @@
+#ifndef UNDOJOURNAL_H
+#define UNDOJOURNAL_H
+
+#include "PieceTable.h" // Large inserts keep their text as a slice of the document
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+
+class Fl_Text_Buffer;
+
+// --- Undo / Redo Journal ---
+// Every buffer change is kept as one compact record: position, inserted and deleted
+// lengths, and the bytes needed to go both ways, stored back to back in an arena of
+// 64 KB blocks (bigger edits get a block of their own). Undo and redo replay a record
+// as a single buffer replace, so a bulk edit such as Replace All undoes in one step.
+//
+// Inserts too big for a shared block keep no copy: the record holds a slice of the
+// document (see PieceSnapshot::slice), which shares the storage the text was put in
+// anyway. It is not counted against the limit, so an Insert File or a reload of any size
+// stays undoable; the bytes it pins once deleted are counted in the delete's record.
+//
+// Consecutive typing, backspacing and forward deleting merge into one record; a new
+// line starts a new one. Edits made between begin_group() and end_group() undo
+// together, with adjacent inserts (e.g. the chunks of Insert File) merged.
+// Once the journal holds more than its limit, the oldest records are dropped, a whole
+// group at a time; the group being recorded is never dropped.
+class UndoJournal {
+public:
+    explicit UndoJournal(size_t limit = 64 * 1024 * 1024) : limit_(limit) {}
+
+    // Called after the edit is in 'doc' (the inserted bytes are read from there)
+    void record(int pos, int nInserted, int nDeleted, const char *deletedText, const PieceTable &doc);
+    void begin_group();
+    void end_group();
+    void clear();
+
+    bool can_undo() const { return cursor_ > 0; }
+    bool can_redo() const { return cursor_ < records_.size(); }
+    // Apply to 'buf' (whose modify callbacks must not record while replaying); return
+    // the position to put the cursor at, or -1 if there was nothing to do
+    int undo(Fl_Text_Buffer &buf);
+    int redo(Fl_Text_Buffer &buf);
+    bool replaying() const { return replaying_; }
+
+    size_t limit() const { return limit_; }
+    void set_limit(size_t bytes);
+    size_t memory() const { return bytes_; } // Record and text bytes currently held
+
+private:
+    struct Record {
+        int pos;
+        int ins, del;        // Text lengths; the arena holds the deleted bytes, then the inserted ones
+        unsigned group;      // Nonzero for records that undo together
+        bool backward;       // Deleted bytes stored last-to-first (merged backspaces)
+        size_t block;        // Sequence number of the arena block holding the text
+        int offset;          // Offset of the text in that block
+        PieceSnapshot shared; // The inserted bytes when not in the arena (large inserts)
+    };
+    struct Block {
+        std::unique_ptr<char[]> data;
+        int size, used;
+    };
+
+    char *text(const Record &r);
+    static int arena_len(const Record &r) { return r.del + (r.shared.length() ? 0 : r.ins); }
+    void append_inserted(const Record &r, std::string *out);
+    char *allocate(int len, Record *r);
+    bool extend(Record &r, int len); // Grows r's text in place if it is the last thing in the arena
+    void truncate_redo();
+    void evict();
+    void apply(Fl_Text_Buffer &buf, const Record &r, bool forward, int *cursor);
+
+    std::deque<Record> records_;
+    size_t cursor_ = 0;            // records_[0, cursor_) are done, the rest can be redone
+    std::deque<Block> blocks_;
+    size_t first_block_ = 0;       // Sequence number of blocks_.front()
+    size_t bytes_ = 0;
+    size_t limit_;
+    unsigned group_ = 0, next_group_ = 0;
+    bool coalesce_ = true;         // Cleared after undo/redo so typing starts a new record
+    bool replaying_ = false;
+};
+
+#endif // UNDOJOURNAL_H
@@ -0,0 +1,584 @@
+// Headless benchmark for the editing core.
+//
+//   bench [--typing | --verify] [size_mb]
+//
+// Builds synthetic documents in memory and runs each workload against the same global
+// buffers and modify callbacks the editor uses, without opening a window. Prints one
+// JSON object: throughput per workload and corpus, per-keystroke latency percentiles,
+// heap allocations per keystroke and the peak resident set size. 'size_mb' (default 16) sets the size of each corpus.
+// '--typing' runs only the typing workloads; it is registered with ctest, and fails if typing allocates.
+// '--verify' runs no workloads, only the equivalence checks below (also a ctest test).
+
+#include "globals.h"
+#include "callbacks.h"
+#include "syntax.h"
+#include "utils.h"
+#include "loader.h"
+#include "redisplay.h"
+#include "SearchPattern.h"
+#include "Regex.h"
+#include "FindAll.h"
+#include "StyleRuns.h"
+
+#include <FL/Fl.H>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h> // For getrusage
+#include <unistd.h>       // For write, close, unlink
+
+// --- Globals normally defined in main.cpp ---
+int changed = 0;
+int loading = 0;
+int swapping = 0;
+char filename[256] = "";
+TextBuffer textbuf;
+Fl_Text_Buffer stylebuf;
+PieceTable document;
+UndoJournal journal(64 * 1024 * 1024);
+CrashJournal crash_journal;
+LineIndex line_index;
+const Language *language = &Language::cpp();
+std::vector<EditorWindow*> windows; // Stays empty: nothing is drawn
+
+// --- Allocation Counter ---
+// Counts operator new on the threads that set 'count_allocations' (the UI thread here, not
+// the highlighter or journal workers). FLTK's own malloc()s, such as the deleted text it
+// hands to the modify callbacks, are not the editor's to avoid and are not counted.
+static thread_local bool count_allocations = false;
+static long long allocations = 0;
+
+void *operator new(size_t size) {
+    if (count_allocations) allocations++;
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// --- Synthetic Corpora ---
+
+// Ordinary C++ source: declarations, strings, comments and preprocessor lines
+static std::string cpp_corpus(size_t bytes) {
+    std::string s;
+    char block[1024];
+    for (int i = 0; s.size() < bytes; i++) {
+        snprintf(block, sizeof(block),
+                 "#include <vector> // item %d\n"
+                 "/* Computes the value of item %d. */\n"
+                 "static int compute_%d(const std::vector<int> &v, int n) {\n"
+                 "    int total = 0; // Running sum\n"
+                 "    for (int i = 0; i < n; i++) {\n"
+                 "        if (v[i] > %d) total += v[i] * 0x%x;\n"
+                 "        else printf(\"item %%d: \\\"%d\\\"\\n\", i);\n"
+                 "    }\n"
+                 "    return total;\n"
+                 "}\n\n", i, i, i, i % 97, i, i);
+        s += block;
+    }
+    s.resize(bytes);
+    return s;
+}
+
+// A single line with no newline at all (minified code, log dumps)
+static std::string long_line_corpus(size_t bytes) {
+    std::string s;
+    char item[128];
+    for (int i = 0; s.size() < bytes; i++) {
+        snprintf(item, sizeof(item), "var a%d=b%d+\"s%d\";if(a%d){c(%d);} ", i, i, i % 13, i, i);
+        s += item;
+    }
+    s.resize(bytes);
+    return s;
+}
+
+// Block comments a megabyte deep, full of text that would be tokens outside a comment
+static std::string comment_corpus(size_t bytes) {
+    std::string s;
+    while (s.size() < bytes) {
+        s += "int before = 1;\n/*\n";
+        for (size_t start = s.size(); s.size() - start < (1 << 20); ) {
+            s += " * for (int i = 0; i < n; i++) \"quoted\" // not a comment start /* nor this\n";
+        }
+        s += " */\nint after = 2;\n";
+    }
+    s.resize(bytes);
+    return s;
+}
+
+// Records of a JSON array, one per line (as in generated data and log exports)
+static std::string json_corpus(size_t bytes) {
+    std::string s = "[\n";
+    char item[256];
+    for (int i = 0; s.size() < bytes; i++) {
+        snprintf(item, sizeof(item),
+                 "  {\"id\": %d, \"name\": \"item \\\"%d\\\"\", \"ok\": %s, \"parent\": null, \"score\": %d.5},\n",
+                 i, i, i % 3 ? "true" : "false", i % 1000);
+        s += item;
+    }
+    s.resize(bytes);
+    return s;
+}
+
+// Dense, short matches for replace-all
+static std::string replace_corpus(size_t bytes) {
+    std::string s;
+    for (int i = 0; s.size() < bytes; i++) {
+        s += (i % 8 == 7) ? "foo(bar);\n" : "foo(bar); ";
+    }
+    s.resize(bytes);
+    return s;
+}
+
+// --- Measurement ---
+
+struct Throughput {
+    const char *workload, *corpus;
+    double bytes, seconds;
+};
+
+struct Latency {
+    const char *workload, *corpus;
+    std::vector<double> us; // One sample per operation
+};
+
+struct StyleMemory {
+    const char *corpus;
+    size_t style_bytes, runs_bytes; // One byte per character, and the same styles as runs
+};
+
+struct Allocations {
+    const char *workload, *corpus;
+    int keystrokes;
+    long long count; // operator new calls over all of them
+};
+
+static std::vector<Throughput> throughputs;
+static std::vector<Latency> latencies;
+static std::vector<StyleMemory> style_memory;
+static std::vector<Allocations> allocation_counts;
+
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Replaces the document the way the editor does on New + paste, styled synchronously
+static void set_document(const std::string &text) {
+    style_deferred = 1;
+    textbuf.text(text.c_str());
+    style_deferred = 0;
+    style_rebuild();
+    journal.clear();
+    damage_flush();
+    changed = 0;
+}
+
+static void bench_style_parse(const char *corpus, const std::string &text, const Language &lang) {
+    std::vector<char> style(text.size() + 1);
+    double best = 1e30;
+    for (int rep = 0; rep < 3; rep++) {
+        double t0 = now();
+        style_parse(text.data(), style.data(), (int)text.size(), 'A', &lang);
+        best = std::min(best, now() - t0);
+    }
+    throughputs.push_back({ "style_parse", corpus, (double)text.size(), best });
+}
+
+// load_file() of the corpus written to disk (named with 'ext', which picks the language)
+// until the last chunk is in, then a full restyle
+static void bench_load(const char *corpus, const std::string &text, const char *ext) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/bench-XXXXXX.%s", ext);
+    int fd = mkstemps(path, (int)strlen(ext) + 1);
+    if (fd < 0 || write(fd, text.data(), text.size()) != (ssize_t)text.size()) {
+        fprintf(stderr, "bench: cannot write %s\n", path);
+        exit(1);
+    }
+    close(fd);
+
+    double t0 = now();
+    load_file(path);
+    while (load_busy()) Fl::wait(0.01); // Chunks arrive through Fl::awake()
+    double t1 = now();
+    style_rebuild(); // Also cancels the background highlighting the load started
+    double t2 = now();
+    unlink(path); // The mapping stays valid
+    journal.clear();
+    damage_flush();
+    throughputs.push_back({ "load_file", corpus, (double)text.size(), t1 - t0 });
+    throughputs.push_back({ "style_rebuild", corpus, (double)text.size(), t2 - t1 });
+}
+
+// Encodes the document's styles as runs (as parking a document does), checks that they
+// expand back to the same bytes, and notes the memory of both
+static void bench_style_runs(const char *corpus) {
+    char *styles = stylebuf.text();
+    int len = stylebuf.length();
+    StyleRuns runs;
+    double t0 = now();
+    runs.append(styles, len);
+    runs.trim();
+    double t1 = now();
+    std::string back(len, '\0');
+    runs.expand(0, len, &back[0]);
+    double t2 = now();
+    if (memcmp(back.data(), styles, len) != 0) {
+        fprintf(stderr, "bench: style runs of %s do not expand to the same styles\n", corpus);
+        exit(1);
+    }
+    free(styles);
+    throughputs.push_back({ "style_runs_encode", corpus, (double)len, t1 - t0 });
+    throughputs.push_back({ "style_runs_expand", corpus, (double)len, t2 - t1 });
+    style_memory.push_back({ corpus, (size_t)len, runs.memory() });
+}
+
+// Types and deletes single characters at random places, one repaint flush per keystroke
+static void bench_keystrokes(const char *corpus, int count) {
+    Latency lat = { "keystroke", corpus, {} };
+    lat.us.reserve(2 * count);
+    std::mt19937 rng(1);
+    long long before = allocations;
+    count_allocations = true;
+    for (int i = 0; i < count; i++) {
+        int pos = (int)(rng() % (textbuf.length() + 1));
+        double t0 = now();
+        textbuf.insert(pos, "x");
+        damage_flush();
+        double t1 = now();
+        textbuf.remove(pos, pos + 1);
+        damage_flush();
+        double t2 = now();
+        lat.us.push_back((t1 - t0) * 1e6);
+        lat.us.push_back((t2 - t1) * 1e6);
+    }
+    count_allocations = false;
+    latencies.push_back(lat);
+    allocation_counts.push_back({ "keystroke", corpus, 2 * count, allocations - before });
+}
+
+// Types a run of characters into one line, as steady typing does, once to warm up (the
+// scratch buffers reach their size, and the piece table and undo journal open the arena
+// blocks the typed text goes in) and once more measured. The measured pass must not
+// allocate at all: its text is a small part of one arena block, and the journal starts
+// with an empty one.
+static void bench_typing(const char *corpus, int count) {
+    Latency lat = { "typing", corpus, {} };
+    lat.us.reserve(count);
+    int start = line_index.line_end(line_index.lines() / 2);
+    long long typed = 0;
+    journal.clear();
+    count_allocations = true;
+    for (int pass = 0; pass < 2; pass++) {
+        long long before = allocations;
+        for (int pos = start; pos < start + count; pos++) {
+            double t0 = now();
+            textbuf.insert(pos, "x");
+            damage_flush();
+            if (pass == 1) lat.us.push_back((now() - t0) * 1e6);
+        }
+        typed = allocations - before;
+        textbuf.remove(start, start + count);
+        damage_flush();
+    }
+    count_allocations = false;
+    if (typed != 0) {
+        fprintf(stderr, "bench: typing into %s allocated %lld times in %d keystrokes\n", corpus, typed, count);
+        exit(1);
+    }
+    latencies.push_back(lat);
+    allocation_counts.push_back({ "typing", corpus, count, typed });
+}
+
+// Go To Line: the start of a random line, and the line of the position found
+static void bench_goto_line(const char *corpus, int count) {
+    Latency lat = { "goto_line", corpus, {} };
+    std::mt19937 rng(2);
+    volatile int sink = 0;
+    for (int i = 0; i < count; i++) {
+        int line = (int)(rng() % line_index.lines());
+        double t0 = now();
+        sink = sink + line_index.line_of(line_index.line_start(line));
+        lat.us.push_back((now() - t0) * 1e6);
+    }
+    latencies.push_back(lat);
+}
+
+// Opening a block comment at the top restyles everything after it
+static void bench_open_comment(const char *corpus) {
+    Latency lat = { "open_comment", corpus, {} };
+    for (int i = 0; i < 3; i++) {
+        double t0 = now();
+        textbuf.insert(0, "/*");
+        damage_flush();
+        double t1 = now();
+        textbuf.remove(0, 2);
+        damage_flush();
+        double t2 = now();
+        lat.us.push_back((t1 - t0) * 1e6);
+        lat.us.push_back((t2 - t1) * 1e6);
+    }
+    latencies.push_back(lat);
+}
+
+// Lazy highlighting (forced on for the corpus): styling the first screen, then screens at
+// random lines as a view jumps around. Restores full highlighting afterwards.
+static void bench_lazy(const char *corpus, int count) {
+    const int SCREEN = 60; // Lines
+    Latency first = { "lazy_first_screen", corpus, {} };
+    Latency jump = { "lazy_jump", corpus, {} };
+    int lazy_min = style_lazy_min;
+    style_lazy_min = 0;
+    style_rebuild_async();
+    double t0 = now();
+    style_visible(0, line_index.line_start(SCREEN));
+    first.us.push_back((now() - t0) * 1e6);
+    std::mt19937 rng(4);
+    for (int i = 0; i < count; i++) {
+        int line = (int)(rng() % line_index.lines());
+        double t1 = now();
+        style_visible(line_index.line_start(line), line_index.line_start(line + SCREEN));
+        jump.us.push_back((now() - t1) * 1e6);
+    }
+    damage_flush();
+    style_lazy_min = lazy_min;
+    style_rebuild();
+    latencies.push_back(first);
+    latencies.push_back(jump);
+}
+
+// Find Again repeated to the end of the document
+static void bench_find(const char *corpus, const char *find) {
+    SearchPattern pattern(find, SEARCH_MATCH_CASE);
+    PieceSnapshot snap = document.snapshot();
+    double t0 = now();
+    for (int pos = pattern.find(snap, 0); pos >= 0; pos = pattern.find(snap, pos + pattern.length())) {}
+    throughputs.push_back({ "find", corpus, (double)snap.length(), now() - t0 });
+}
+
+static void bench_find_all(const char *corpus, const char *find, bool regex) {
+    SearchPattern pattern(find, SEARCH_MATCH_CASE);
+    Regex re(find, SEARCH_MATCH_CASE);
+    FindAllMatcher match;
+    if (regex) {
+        match = [&](const PieceSnapshot &snap, int from, int stop, int *start, int *end) {
+            RegexMatch m;
+            if (!re.find(snap, from, &m, stop)) return false;
+            *start = m.start;
+            *end = m.end;
+            return true;
+        };
+    } else {
+        match = [&](const PieceSnapshot &snap, int from, int stop, int *start, int *end) {
+            *start = pattern.find(snap, from, stop);
+            *end = *start + pattern.length();
+            return *start >= 0;
+        };
+    }
+    PieceSnapshot snap = document.snapshot();
+    std::vector<FindResult> results;
+    double t0 = now();
+    find_all(snap, match, &results, 1000);
+    throughputs.push_back({ regex ? "find_all_regex" : "find_all", corpus, (double)snap.length(), now() - t0 });
+}
+
+static void bench_replace_all(const char *corpus, const std::string &text, bool regex) {
+    set_document(text);
+    double t0 = now();
+    if (regex) replace_all(Regex("foo\\(([a-z]+)\\)", SEARCH_MATCH_CASE), "\\1.foo()");
+    else replace_all("foo", "quux", SEARCH_MATCH_CASE);
+    damage_flush();
+    throughputs.push_back({ regex ? "replace_all_regex" : "replace_all", corpus, (double)text.size(), now() - t0 });
+}
+
+// --- Equivalence Checks ---
+// Fast paths that must give exactly what the plain version gives. Each exits with 1,
+// naming the first byte that differs, if they do not.
+
+static void check_same(const char *what, const char *corpus, const char *got, const char *expected, size_t len) {
+    const char *at = std::mismatch(got, got + len, expected).first;
+    if (at == got + len) return;
+    fprintf(stderr, "bench: %s of %s differs at byte %zu\n", what, corpus, (size_t)(at - got));
+    exit(1);
+}
+
+// style_parse() skipping runs with SIMD against the same parse a byte at a time
+static void verify_scalar(const char *corpus, const std::string &text, const Language &lang) {
+    std::vector<char> simd(text.size()), scalar(text.size());
+    style_parse(text.data(), simd.data(), (int)text.size(), 'A', &lang);
+    style_scalar = 1;
+    style_parse(text.data(), scalar.data(), (int)text.size(), 'A', &lang);
+    style_scalar = 0;
+    check_same("SIMD style_parse", corpus, simd.data(), scalar.data(), text.size());
+}
+
+// style_rebuild(), which lexes line-aligned chunks in parallel, all but the first from a
+// guessed state, and stitches them, against one sequential style_parse() of the text
+static void verify_parallel(const char *corpus, const std::string &text, const char *ext) {
+    bench_load(corpus, text, ext); // Ends with a style_rebuild()
+    std::vector<char> expected(text.size());
+    style_parse(text.data(), expected.data(), (int)text.size(), 'A', language);
+    if (stylebuf.length() != (int)text.size()) {
+        fprintf(stderr, "bench: parallel style_rebuild of %s styled %d bytes of %zu\n", corpus, stylebuf.length(), text.size());
+        exit(1);
+    }
+    char *styles = stylebuf.text();
+    check_same("parallel style_rebuild", corpus, styles, expected.data(), text.size());
+    free(styles);
+}
+
+// --- Report ---
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+    return v[i];
+}
+
+static long peak_rss_kb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024; // Bytes on macOS
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+static void report(int size_mb) {
+    printf("{\n  \"size_mb\": %d,\n  \"throughput\": [\n", size_mb);
+    for (size_t i = 0; i < throughputs.size(); i++) {
+        const Throughput &t = throughputs[i];
+        printf("    {\"workload\": \"%s\", \"corpus\": \"%s\", \"bytes\": %.0f, \"seconds\": %.6f, \"mb_per_s\": %.1f}%s\n",
+               t.workload, t.corpus, t.bytes, t.seconds, t.seconds > 0 ? t.bytes / (1 << 20) / t.seconds : 0.0,
+               i + 1 < throughputs.size() ? "," : "");
+    }
+    printf("  ],\n  \"latency\": [\n");
+    for (size_t i = 0; i < latencies.size(); i++) {
+        const Latency &l = latencies[i];
+        printf("    {\"workload\": \"%s\", \"corpus\": \"%s\", \"samples\": %zu, \"p50_us\": %.1f, \"p90_us\": %.1f, "
+               "\"p99_us\": %.1f, \"max_us\": %.1f}%s\n",
+               l.workload, l.corpus, l.us.size(), percentile(l.us, 0.5), percentile(l.us, 0.9),
+               percentile(l.us, 0.99), percentile(l.us, 1.0), i + 1 < latencies.size() ? "," : "");
+    }
+    printf("  ],\n  \"style_memory\": [\n");
+    for (size_t i = 0; i < style_memory.size(); i++) {
+        const StyleMemory &m = style_memory[i];
+        printf("    {\"corpus\": \"%s\", \"style_bytes\": %zu, \"runs_bytes\": %zu}%s\n",
+               m.corpus, m.style_bytes, m.runs_bytes, i + 1 < style_memory.size() ? "," : "");
+    }
+    printf("  ],\n  \"allocations\": [\n");
+    for (size_t i = 0; i < allocation_counts.size(); i++) {
+        const Allocations &a = allocation_counts[i];
+        printf("    {\"workload\": \"%s\", \"corpus\": \"%s\", \"keystrokes\": %d, \"allocations\": %lld, "
+               "\"per_keystroke\": %.4f}%s\n",
+               a.workload, a.corpus, a.keystrokes, a.count, a.keystrokes ? (double)a.count / a.keystrokes : 0.0,
+               i + 1 < allocation_counts.size() ? "," : "");
+    }
+    printf("  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb());
+}
+
+// --- Main ---
+int main(int argc, char **argv) {
+    // "--typing" runs only the typing workloads, whose allocation check is a ctest test,
+    // and "--verify" only the equivalence checks
+    bool typing_only = argc > 1 && strcmp(argv[1], "--typing") == 0;
+    bool verify = argc > 1 && strcmp(argv[1], "--verify") == 0;
+    if (typing_only || verify) { argc--; argv++; }
+    int size_mb = argc > 1 ? atoi(argv[1]) : 16;
+    if (size_mb <= 0) {
+        fprintf(stderr, "usage: %s [--typing | --verify] [size_mb]\n", argv[0]);
+        return 2;
+    }
+    size_t bytes = (size_t)size_mb << 20;
+
+    Fl::lock(); // The loader and the background highlighter post via Fl::awake()
+
+    // The same modify callbacks as main(), in the same order
+    textbuf.canUndo(0);
+    textbuf.add_modify_callback(style_update, nullptr);
+    textbuf.add_modify_callback(changed_cb, nullptr);
+    textbuf.add_modify_callback(journal_update, nullptr);
+    textbuf.add_modify_callback(recovery_update, nullptr);
+    textbuf.add_modify_callback(line_index_update, nullptr);
+    textbuf.add_modify_callback(document_update, nullptr);
+
+    if (typing_only) {
+        bench_load("cpp", cpp_corpus(bytes), "cpp");
+        bench_typing("cpp", 2000);
+        bench_load("comment", comment_corpus(bytes), "cpp");
+        bench_typing("comment", 2000);
+        bench_load("json", json_corpus(bytes), "json");
+        bench_typing("json", 2000);
+        crash_journal.stop();
+        report(size_mb);
+        return 0; // bench_typing() has exited with 1 if typing allocated
+    }
+
+    std::string cpp = cpp_corpus(bytes);
+    std::string line = long_line_corpus(bytes);
+    std::string comment = comment_corpus(bytes);
+    std::string dense = replace_corpus(bytes);
+    std::string json = json_corpus(bytes);
+
+    if (verify) {
+        const Language &json_lang = *Language::for_path("x.json");
+        verify_scalar("cpp", cpp, Language::cpp());
+        verify_scalar("long_line", line, Language::cpp());
+        verify_scalar("comment", comment, Language::cpp());
+        verify_scalar("json", json, json_lang);
+        verify_scalar("dense", dense, Language::cpp());
+        verify_parallel("cpp", cpp, "cpp");
+        verify_parallel("long_line", line, "cpp");
+        verify_parallel("comment", comment, "cpp");
+        verify_parallel("json", json, "json");
+        verify_parallel("dense", dense, "cpp");
+        crash_journal.stop();
+        printf("bench: all checks passed\n");
+        return 0;
+    }
+
+    bench_style_parse("cpp", cpp, Language::cpp());
+    bench_style_parse("long_line", line, Language::cpp());
+    bench_style_parse("comment", comment, Language::cpp());
+    bench_style_parse("json", json, *Language::for_path("x.json"));
+
+    bench_load("cpp", cpp, "cpp");
+    bench_style_runs("cpp");
+    bench_keystrokes("cpp", 1000);
+    bench_typing("cpp", 2000);
+    bench_goto_line("cpp", 10000);
+    bench_open_comment("cpp");
+    bench_lazy("cpp", 200);
+    bench_find("cpp", "total");
+    bench_find_all("cpp", "total", false);
+    bench_find_all("cpp", "v\\[[a-z]+\\]", true);
+
+    bench_load("long_line", line, "cpp");
+    bench_keystrokes("long_line", 200);
+
+    bench_load("comment", comment, "cpp");
+    bench_style_runs("comment");
+    bench_keystrokes("comment", 1000);
+    bench_typing("comment", 2000);
+    bench_open_comment("comment");
+
+    bench_load("json", json, "json");
+    bench_style_runs("json");
+    bench_keystrokes("json", 1000);
+    bench_typing("json", 2000);
+
+    bench_replace_all("dense", dense, false);
+    bench_replace_all("dense", dense, true);
+
+    crash_journal.stop(); // The journal of the last corpus loaded
+    report(size_mb);
+    return 0;
+}
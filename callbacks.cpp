@@ -1,27 +1,92 @@
 #include "callbacks.h"
 #include "EditorWindow.h" // To access EditorWindow members from user data 'v'
 #include "globals.h"      // Access to global buffers, filename, changed flag etc.
-#include "utils.h"        // Access to helper functions like check_save, load_file etc.
+#include "utils.h"        // Access to helper functions like check_save, replace_all etc.
 #include "syntax.h"       // For style_update calling redisplay_range
+#include "SearchPattern.h" // Find / Replace engine
+#include "Regex.h"         // Regular expression Find / Replace
+#include "FindAll.h"       // Parallel Find All
+#include "redisplay.h"     // For changed_cb deferring title updates
+#include "Perf.h"          // Timers on the modify callbacks and searches
+#include "loader.h"        // For load_file; editing waits for a load to finish
+#include "saver.h"         // For save_file
+#include "workspace.h"     // Documents behind the tabs
 
 #include <FL/Fl_Text_Editor.H>
+#include <FL/Fl_Menu_.H>
 #include <FL/fl_ask.H>
 #include <FL/Fl_File_Chooser.H>
 #include <string>
 #include <vector>
 #include <cstdlib> // For exit()
+#include <cstdio>  // For snprintf
+#include <cstring> // For strerror, strncpy
+#include <cerrno>  // For errno
+#include <memory>
+#include <chrono>  // For timing Find All
 
 // --- Callback Implementations ---
 
 // Buffer modify callbacks (global)
 void changed_cb(int, int nInserted, int nDeleted, int, const char*, void* /*v*/) {
-    if ((nInserted || nDeleted) && !loading) changed = 1;
-    // Update title for all windows
-    for (EditorWindow* w : windows) {
-        set_title(w);
+    PerfScope timer(PERF_CHANGED_CB);
+    if ((nInserted || nDeleted) && !loading && !swapping) changed = 1;
+    damage_titles(); // Titles of all windows are refreshed once, after the event
+    damage_status(); // So are the line:column displays (edits in one view move the others' text)
+}
+
+// Copies textbuf's [pos, pos + len) into the document at 'pos', straight out of the gap
+// buffer: it is contiguous except where it straddles the gap, so each run's end is found
+// by binary search on address()
+static void document_copy_in(int pos, int len) {
+    int done = 0;
+    while (done < len) {
+        const char *run = textbuf.address(pos + done);
+        int lo = 1, hi = len - done; // run[0, lo) is known to be contiguous
+        while (lo < hi) {
+            int mid = lo + (hi - lo + 1) / 2;
+            if (textbuf.address(pos + done + mid - 1) == run + mid - 1) lo = mid; else hi = mid - 1;
+        }
+        document.insert(pos + done, run, lo);
+        done += lo;
     }
 }
 
+// Mirrors every textbuf edit into the piece table document
+void document_update(int pos, int nInserted, int nDeleted, int, const char*, void* /*v*/) {
+    if (swapping) return; // load_file() has already reset the document
+    PerfScope timer(PERF_DOCUMENT_UPDATE, nInserted + nDeleted);
+    if (nDeleted > 0) document.remove(pos, nDeleted);
+    document_copy_in(pos, nInserted);
+}
+
+void document_detach() {
+    PerfScope timer(PERF_DOCUMENT_UPDATE, textbuf.length());
+    document.clear();
+    document_copy_in(0, textbuf.length());
+}
+
+// Records every textbuf edit in the undo journal (after document_update has applied it)
+void journal_update(int pos, int nInserted, int nDeleted, int, const char *deletedText, void* /*v*/) {
+    if (swapping || journal.replaying()) return;
+    PerfScope timer(PERF_JOURNAL_UPDATE);
+    journal.record(pos, nInserted, nDeleted, deletedText, document);
+}
+
+// Logs every textbuf edit, undo and redo included, to the crash recovery journal
+void recovery_update(int pos, int nInserted, int nDeleted, int, const char*, void* /*v*/) {
+    if (swapping) return; // A document being swapped in is not an edit; its journal starts when it is in
+    PerfScope timer(PERF_RECOVERY_UPDATE, nInserted);
+    crash_journal.record(pos, nInserted, nDeleted, document);
+}
+
+// Keeps the line index in step with textbuf, including a document being swapped in:
+// load_file() puts each chunk in the document before textbuf, so its bytes are there
+void line_index_update(int pos, int nInserted, int nDeleted, int, const char*, void* /*v*/) {
+    PerfScope timer(PERF_LINE_INDEX_UPDATE, nInserted + nDeleted);
+    line_index.update(pos, nInserted, nDeleted, document);
+}
+
 // style_update is defined in syntax.cpp as it's part of syntax highlighting logic
 
 // Menu item callbacks
@@ -33,6 +98,7 @@ void copy_cb(Fl_Widget*, void* v) {
 }
 
 void cut_cb(Fl_Widget*, void* v) {
+    if (load_busy()) return; // Read-only until the file has streamed in
     EditorWindow* e = (EditorWindow*)v;
      if (e && e->editor) { // Safety check
         Fl_Text_Editor::kf_cut(0, e->editor);
@@ -40,9 +106,31 @@ void cut_cb(Fl_Widget*, void* v) {
 }
 
 void delete_cb(Fl_Widget*, void* /*v*/) {
+    if (load_busy()) return; // Read-only until the file has streamed in
     textbuf.remove_selection(); // Operates on the shared buffer
 }
 
+// Compiled regex for 'pattern' with the window's flags, reusing the cached one when
+// neither changed (so Find Again / Replace Again do not recompile). Alerts on errors.
+static const Regex *compiled_regex(EditorWindow *e, const char *pattern) {
+    if (!e->regex || e->regex->pattern() != pattern || e->regex->flags() != e->search_flags) {
+        e->regex.reset(new Regex(pattern, e->search_flags));
+    }
+    if (!e->regex->ok()) {
+        fl_alert("Bad regular expression \'%s\': %s", pattern, e->regex->error());
+        return nullptr;
+    }
+    return e->regex.get();
+}
+
+// Next regex match at or after 'pos', skipping an empty match right at 'pos' so that
+// repeating the search moves on
+static bool find_regex(const Regex &re, const PieceSnapshot &snap, int pos, RegexMatch *m) {
+    if (!re.find(snap, pos, m)) return false;
+    if (m->end == pos && m->start == pos) return pos < snap.length() && re.find(snap, pos + 1, m);
+    return true;
+}
+
 void find_cb(Fl_Widget* w, void* v) {
     EditorWindow* e = (EditorWindow*)v;
     if (!e) return;
@@ -63,20 +151,146 @@ void find2_cb(Fl_Widget* /*w*/, void* v) { // Find Again
     }
 
     int pos = e->editor->insert_position();
-    int found_pos = pos;
+    int found_pos, found_end;
+    if (e->search_flags & SEARCH_REGEX) {
+        const Regex *re = compiled_regex(e, e->search);
+        if (!re) return;
+        PerfScope timer(PERF_FIND);
+        RegexMatch m;
+        found_pos = find_regex(*re, document.snapshot(), pos, &m) ? m.start : -1;
+        found_end = m.end;
+    } else {
+        PerfScope timer(PERF_FIND);
+        SearchPattern pattern(e->search, e->search_flags);
+        found_pos = pattern.find(document.snapshot(), pos);
+        found_end = found_pos + pattern.length();
+    }
 
-    if (textbuf.search_forward(pos, e->search, &found_pos)) {
-        textbuf.select(found_pos, found_pos + strlen(e->search));
-        e->editor->insert_position(found_pos + strlen(e->search));
-        e->editor->show_insert_position();
+    if (found_pos >= 0) {
+        textbuf.select(found_pos, found_end);
+        e->editor->insert_position(found_end);
+        e->editor->show_insert_line();
     } else {
         fl_alert("No more occurrences of \'%s\' found!", e->search);
     }
 }
 
+void findall_cb(Fl_Widget*, void* v) { // Find All: every match listed in the results panel
+    EditorWindow* e = (EditorWindow*)v;
+    if (!e || !e->findall_list) return;
+    const char *val = fl_input("Find All:", e->search);
+    if (val == NULL || val[0] == '\0') return;
+    strncpy(e->search, val, sizeof(e->search) - 1);
+    e->search[sizeof(e->search) - 1] = '\0';
+
+    FindAllMatcher match;
+    std::unique_ptr<SearchPattern> pattern;
+    if (e->search_flags & SEARCH_REGEX) {
+        const Regex *re = compiled_regex(e, e->search);
+        if (!re) return;
+        match = [re](const PieceSnapshot &snap, int from, int stop, int *start, int *end) {
+            RegexMatch m;
+            if (!re->find(snap, from, &m, stop)) return false;
+            *start = m.start; *end = m.end;
+            return true;
+        };
+    } else {
+        pattern.reset(new SearchPattern(e->search, e->search_flags));
+        if (pattern->length() == 0) return;
+        const SearchPattern *p = pattern.get();
+        match = [p](const PieceSnapshot &snap, int from, int stop, int *start, int *end) {
+            *start = p->find(snap, from, stop);
+            *end = *start + p->length();
+            return *start >= 0;
+        };
+    }
+
+    const size_t MAX_LISTED = 10000; // The count is exact; the list stops here
+    PieceSnapshot snap = document.snapshot();
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    e->findall_results.clear();
+    int times = find_all(snap, match, &e->findall_results, MAX_LISTED);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    e->findall_list->clear();
+    for (const FindResult &r : e->findall_results) {
+        std::string line = std::to_string(r.line) + ":" + std::to_string(r.col) + ": " + find_all_context(snap, r);
+        e->findall_list->add(line.c_str());
+    }
+    if (times > (int)e->findall_results.size()) {
+        e->findall_list->add(("... " + std::to_string(times - (int)e->findall_results.size()) + " more").c_str());
+    }
+    char label[320];
+    snprintf(label, sizeof(label), "Find All: %d matches for '%s' (%.1f ms)", times, e->search, ms);
+    e->findall_dlg->copy_label(label);
+    e->findall_dlg->show();
+}
+
+// Jump to the clicked Find All result, in the view the user last worked in: all views
+// show the same document, and the window that ran Find All may not be that one
+void findall_pick_cb(Fl_Widget*, void* v) {
+    EditorWindow* e = (EditorWindow*)v;
+    if (!e || !e->editor || !e->findall_list) return;
+    int i = e->findall_list->value() - 1; // Browser lines are 1-based
+    if (i < 0 || i >= (int)e->findall_results.size()) return;
+    const FindResult &r = e->findall_results[i];
+    if (r.end > textbuf.length()) return; // Stale: the text has since been cut short
+    TextView *view = TextView::last_focused();
+    if (!view) view = e->editor;
+    textbuf.select(r.start, r.end);
+    view->insert_position(r.end);
+    view->show_insert_line();
+}
+
+void goto_cb(Fl_Widget*, void* v) { // Search > Go To Line
+    EditorWindow* e = (EditorWindow*)v;
+    if (!e || !e->editor) return;
+    char prompt[64];
+    snprintf(prompt, sizeof(prompt), "Go to line (1 - %d):", line_index.lines());
+    const char *val = fl_input(prompt, "");
+    if (val == NULL || val[0] == '\0') return;
+    char *end;
+    long line = strtol(val, &end, 10);
+    if (end == val) {
+        fl_alert("\'%s\' is not a line number.", val);
+        return;
+    }
+    if (line < 1) line = 1;
+    if (line > line_index.lines()) line = line_index.lines();
+    textbuf.unselect();
+    e->editor->insert_position(line_index.line_start((int)line - 1));
+    e->editor->show_insert_line();
+    damage_status();
+}
+
+void matchcase_cb(Fl_Widget* w, void* v) { // Search > Match Case toggle
+    EditorWindow* e = (EditorWindow*)v;
+    const Fl_Menu_Item* item = ((Fl_Menu_*)w)->mvalue();
+    if (!e || !item) return;
+    if (item->value()) e->search_flags |= SEARCH_MATCH_CASE;
+    else e->search_flags &= ~SEARCH_MATCH_CASE;
+}
+
+void wholeword_cb(Fl_Widget* w, void* v) { // Search > Whole Word toggle
+    EditorWindow* e = (EditorWindow*)v;
+    const Fl_Menu_Item* item = ((Fl_Menu_*)w)->mvalue();
+    if (!e || !item) return;
+    if (item->value()) e->search_flags |= SEARCH_WHOLE_WORD;
+    else e->search_flags &= ~SEARCH_WHOLE_WORD;
+}
+
+void regex_cb(Fl_Widget* w, void* v) { // Search > Regular Expression toggle
+    EditorWindow* e = (EditorWindow*)v;
+    const Fl_Menu_Item* item = ((Fl_Menu_*)w)->mvalue();
+    if (!e || !item) return;
+    if (item->value()) e->search_flags |= SEARCH_REGEX;
+    else e->search_flags &= ~SEARCH_REGEX;
+}
+
 void insert_cb(Fl_Widget*, void* v) { // Insert File
     EditorWindow* e = (EditorWindow*)v;
     if (!e || !e->editor) return;
+    if (load_busy()) return; // Read-only until the file has streamed in
     char *newfile = fl_file_chooser("Insert File?", "*", filename); // Use global filename as default suggestion
     if (newfile != NULL) {
         int pos = e->editor->insert_position();
@@ -85,25 +299,35 @@ void insert_cb(Fl_Widget*, void* v) { // Insert File
 }
 
 void new_cb(Fl_Widget*, void* /*v*/) {
-    if (!check_save()) return; // Global check
-    filename[0] = '\0';
-    textbuf.select(0, textbuf.length());
-    textbuf.remove_selection();
-    stylebuf.select(0, stylebuf.length());
-    stylebuf.remove_selection();
-    changed = 0;
-    textbuf.call_modify_callbacks(); // Update all views
+    if (document_reusable()) return; // Already an empty untitled document
+    document_new(); // In a tab of its own; the others stay open
 }
 
 void open_cb(Fl_Widget*, void* /*v*/) {
-    if (!check_save()) return; // Global check
     char *newfile = fl_file_chooser("Open File?", "*", filename);
-    if (newfile != NULL) {
-        load_file(newfile); // Load into shared buffer
+    if (newfile == NULL) return;
+    int open = document_find(newfile);
+    if (open >= 0) {
+        document_switch(open); // Already open: show its tab
+        return;
     }
+    if (!document_reusable() && !document_new()) return;
+    load_file(newfile); // Into the new (or empty) document
+}
+
+void closefile_cb(Fl_Widget*, void* /*v*/) { // Close File: its tab goes, the windows stay
+    document_close();
+}
+
+void tab_cb(Fl_Widget*, void* v) { // A document tab was picked
+    EditorWindow* e = (EditorWindow*)v;
+    if (!e || !e->tabs) return;
+    int index = e->tabs->find(e->tabs->value());
+    if (!document_switch(index)) e->update_tabs(); // Back to the active document's tab
 }
 
 void paste_cb(Fl_Widget*, void* v) {
+    if (load_busy()) return; // Read-only until the file has streamed in
     EditorWindow* e = (EditorWindow*)v;
     if (e && e->editor) { // Safety check
         Fl_Text_Editor::kf_paste(0, e->editor);
@@ -137,6 +361,7 @@ void replace_cb(Fl_Widget*, void* v) {
 }
 
 void replace2_cb(Fl_Widget*, void* v) { // Replace Again / Replace Next
+    if (load_busy()) return; // Read-only until the file has streamed in
     EditorWindow* e = (EditorWindow*)v;
     if (!e || !e->editor || !e->replace_find || !e->replace_with || !e->replace_dlg) return;
 
@@ -149,21 +374,40 @@ void replace2_cb(Fl_Widget*, void* v) { // Replace Again / Replace Next
     }
 
     int pos = e->editor->insert_position();
-    int found_pos = pos;
-
-    if (textbuf.search_forward(pos, find, &found_pos)) {
-        textbuf.select(found_pos, found_pos + strlen(find));
-        textbuf.remove_selection();
-        textbuf.insert(found_pos, replace);
-        textbuf.select(found_pos, found_pos + strlen(replace));
-        e->editor->insert_position(found_pos + strlen(replace));
-        e->editor->show_insert_position();
+    int found_pos, found_end;
+    std::string expanded;
+    if (e->search_flags & SEARCH_REGEX) {
+        const Regex *re = compiled_regex(e, find);
+        if (!re) return;
+        PerfScope timer(PERF_FIND);
+        PieceSnapshot snap = document.snapshot();
+        RegexMatch m;
+        found_pos = find_regex(*re, snap, pos, &m) ? m.start : -1;
+        found_end = m.end;
+        if (found_pos >= 0) {
+            expanded = Regex::expand(replace, m, snap);
+            replace = expanded.c_str();
+        }
+    } else {
+        PerfScope timer(PERF_FIND);
+        SearchPattern pattern(find, e->search_flags);
+        found_pos = pattern.find(document.snapshot(), pos);
+        found_end = found_pos + pattern.length();
+    }
+
+    if (found_pos >= 0) {
+        int replace_len = (int)strlen(replace);
+        textbuf.replace(found_pos, found_end, replace);
+        textbuf.select(found_pos, found_pos + replace_len);
+        e->editor->insert_position(found_pos + replace_len);
+        e->editor->show_insert_line();
     } else {
         fl_alert("No more occurrences of \'%s\' found!", find);
     }
 }
 
 void replall_cb(Fl_Widget*, void* v) {
+    if (load_busy()) return; // Read-only until the file has streamed in
     EditorWindow* e = (EditorWindow*)v;
      if (!e || !e->replace_find || !e->replace_with || !e->replace_dlg) return;
 
@@ -176,19 +420,18 @@ void replall_cb(Fl_Widget*, void* v) {
     }
     e->replace_dlg->hide();
 
-    int times = 0;
-    int pos = 0;
-    int found_pos = 0;
-
-    while(textbuf.search_forward(pos, find, &found_pos)) {
-        textbuf.select(found_pos, found_pos + strlen(find));
-        textbuf.remove_selection();
-        textbuf.insert(found_pos, replace);
-        pos = found_pos + strlen(replace);
-        times++;
+    int times;
+    if (e->search_flags & SEARCH_REGEX) {
+        const Regex *re = compiled_regex(e, find);
+        if (!re) return;
+        times = replace_all(*re, replace);
+    } else {
+        times = replace_all(find, replace, e->search_flags);
     }
 
-    if (times > 0) {
+    if (times < 0) {
+        fl_alert("Nothing was replaced: the result would contain a NUL byte, which the editor cannot hold.");
+    } else if (times > 0) {
         fl_message("Replaced %d occurrences.", times);
         changed = 1;
         textbuf.call_modify_callbacks();
@@ -219,24 +462,68 @@ void saveas_cb(Fl_Widget*, void* /*v*/) {
     }
 }
 
-void undo_cb(Fl_Widget*, void* /*v*/) { // Undo
-    textbuf.undo();
-    textbuf.call_modify_callbacks(); // Trigger restyle and title update
+void undo_cb(Fl_Widget*, void* v) { // Undo
+    if (load_busy()) return; // Read-only until the file has streamed in
+    EditorWindow* e = (EditorWindow*)v;
+    int pos = journal.undo(textbuf);
+    if (pos < 0) return;
+    textbuf.unselect();
+    if (e && e->editor) {
+        e->editor->insert_position(pos);
+        e->editor->show_insert_line();
+    }
+}
+
+void redo_cb(Fl_Widget*, void* v) { // Redo
+    if (load_busy()) return; // Read-only until the file has streamed in
+    EditorWindow* e = (EditorWindow*)v;
+    int pos = journal.redo(textbuf);
+    if (pos < 0) return;
+    textbuf.unselect();
+    if (e && e->editor) {
+        e->editor->insert_position(pos);
+        e->editor->show_insert_line();
+    }
 }
 
 void view_cb(Fl_Widget*, void* /*v*/) { // New View
     new_view()->show(); // Calls global utility function
 }
 
+// Refreshes the performance overlay of every window showing it, twice a second
+static void perf_tick(void*) {
+    std::string summary;
+    for (EditorWindow* w : windows) {
+        if (!w || !w->perf_bar || !w->perf_bar->visible()) continue;
+        if (summary.empty()) summary = perf_summary();
+        w->perf_bar->copy_label(summary.c_str());
+    }
+    if (!summary.empty()) Fl::repeat_timeout(0.5, perf_tick);
+}
+
+void perf_cb(Fl_Widget* w, void* v) { // View > Performance Overlay toggle
+    EditorWindow* e = (EditorWindow*)v;
+    const Fl_Menu_Item* item = ((Fl_Menu_*)w)->mvalue();
+    if (!e || !item) return;
+    e->show_perf_bar(item->value() != 0);
+    if (item->value() && !Fl::has_timeout(perf_tick)) Fl::add_timeout(0.0, perf_tick);
+}
+
+void perftrace_cb(Fl_Widget*, void*) { // View > Save Performance Trace
+    const char *path = fl_file_chooser("Save Performance Trace As?", "*.json", "trace.json");
+    if (path == NULL) return;
+    if (!perf_write_trace(path)) {
+        fl_alert("Error writing to file \'%s\':\n%s.", path, strerror(errno));
+    }
+}
+
 void close_cb(Fl_Widget* /*w*/, void* v) { // Close View (also window close)
     EditorWindow* window_to_close = (EditorWindow*)v;
     if (!window_to_close) return;
 
     // Only prompt to save if this is the *last* window being closed
-    if (changed && windows.size() == 1) {
-         if (!check_save()) { // Global check_save
-             return; // User cancelled save, don't close
-         }
+    if (windows.size() == 1 && !document_close_all()) {
+        return; // User cancelled a save, don't close
     }
 
     window_to_close->hide();
@@ -7,7 +7,14 @@
 
 // Buffer modify callbacks (global)
 void changed_cb(int, int, int, int, const char*, void*);
+void document_update(int pos, int nInserted, int nDeleted, int, const char*, void*);
+void journal_update(int pos, int nInserted, int nDeleted, int, const char *deletedText, void*);
+void recovery_update(int pos, int nInserted, int nDeleted, int, const char*, void*);
+void line_index_update(int pos, int nInserted, int nDeleted, int, const char*, void*);
 void style_update(int pos, int nInserted, int nDeleted, int nRestyled, const char *deletedText, void *cbArg);
+// Gives the document its own copy of textbuf's text, so none of it is read from a mapped
+// file any more (which another program may rewrite or cut short)
+void document_detach();
 
 // Menu item callbacks
 void copy_cb(Fl_Widget*, void* v);
@@ -15,9 +22,16 @@ void cut_cb(Fl_Widget*, void* v);
 void delete_cb(Fl_Widget*, void* v);
 void find_cb(Fl_Widget* w, void* v);
 void find2_cb(Fl_Widget* w, void* v); // Find Again
+void findall_cb(Fl_Widget* w, void* v); // Find All
+void goto_cb(Fl_Widget* w, void* v); // Go To Line
+void matchcase_cb(Fl_Widget* w, void* v); // Match Case toggle
+void wholeword_cb(Fl_Widget* w, void* v); // Whole Word toggle
+void regex_cb(Fl_Widget* w, void* v); // Regular Expression toggle
 void insert_cb(Fl_Widget*, void* v); // Insert File
 void new_cb(Fl_Widget*, void* v);
 void open_cb(Fl_Widget*, void* v);
+void closefile_cb(Fl_Widget*, void* v); // Close File
+void tab_cb(Fl_Widget*, void* v); // Document tab picked
 void paste_cb(Fl_Widget*, void* v);
 void quit_cb(Fl_Widget*, void* v);
 void replace_cb(Fl_Widget*, void* v);
@@ -25,13 +39,19 @@ void replace2_cb(Fl_Widget*, void* v); // Replace Again / Replace Next
 void save_cb(Fl_Widget*, void* v);
 void saveas_cb(Fl_Widget*, void* v);
 void undo_cb(Fl_Widget*, void* v); // Undo
+void redo_cb(Fl_Widget*, void* v); // Redo
 void view_cb(Fl_Widget*, void* v); // New View
 void close_cb(Fl_Widget* w, void* v); // Close View (also window close)
+void perf_cb(Fl_Widget* w, void* v); // Performance Overlay toggle
+void perftrace_cb(Fl_Widget*, void* v); // Save Performance Trace
 
 // Replace dialog button callbacks
 void replall_cb(Fl_Widget*, void* v);
 void replcan_cb(Fl_Widget*, void* v);
 // replace2_cb is used for replace_next button
 
+// Find All results list callback
+void findall_pick_cb(Fl_Widget*, void* v);
+
 #endif // CALLBACKS_H
 
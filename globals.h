@@ -3,16 +3,28 @@
 
 #include <FL/Fl_Text_Buffer.H>
 #include <vector>
+#include "TextBuffer.h"   // textbuf's type
 #include "EditorWindow.h" // Include EditorWindow definition for the vector
+#include "PieceTable.h"   // Document model mirrored from textbuf
+#include "UndoJournal.h"  // Undo / redo history
+#include "CrashJournal.h" // Crash recovery journal
+#include "LineIndex.h"    // Line starts of textbuf
+#include "Language.h"     // Highlighting rules
 
 // --- Global Variables (Declarations) ---
 // These are defined in main.cpp
 
 extern int changed;
 extern int loading;
+extern int swapping; // Set while load_file() swaps in a whole new document (mirror callbacks skip it)
 extern char filename[256];
-extern Fl_Text_Buffer textbuf;  // Shared text buffer
+extern TextBuffer textbuf;      // Shared text buffer
 extern Fl_Text_Buffer stylebuf; // Shared style buffer
+extern PieceTable document;     // Piece table copy of textbuf, readable via snapshots
+extern UndoJournal journal;     // Undo / redo history of textbuf
+extern CrashJournal crash_journal; // Unsaved edits of textbuf, on disk for recovery
+extern LineIndex line_index;    // Line numbers and line starts of textbuf
+extern const Language *language; // Highlighting rules of the document, chosen when it is loaded
 extern std::vector<EditorWindow*> windows; // List of open editor windows
 
 #endif // GLOBALS_H
@@ -0,0 +1,276 @@
+#include "loader.h"
+#include "globals.h"    // For textbuf, document, journal, filename, language, changed, loading, swapping
+#include "MappedFile.h" // Regular files are mapped; the document keeps the mapping
+#include "redisplay.h"  // For damage_titles (progress is shown in the title)
+#include "syntax.h"     // For style_rebuild
+#include "saver.h"      // For save_wait
+#include "utils.h"      // For recover_or_start_journal
+#include "watcher.h"    // For watch_file
+#include "Perf.h"
+
+#include <FL/Fl.H>
+#include <FL/fl_ask.H>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <climits>
+#include <cstdio>  // For fopen, fread
+#include <cstring> // For strerror
+
+// --- Chunks ---
+
+namespace {
+struct LoadChunk {
+    unsigned generation;
+    std::shared_ptr<MappedFile> map; // Source of the bytes when the file is mapped
+    int offset;                      // Position of the text in the file
+    std::vector<char> text;          // '\0' terminated copy for textbuf
+    bool done = false;               // End of file (or error) marker
+    int error = 0;
+};
+}
+
+static const int FIRST_CHUNK = 64 * 1024;      // About a screenful, so something shows at once
+static const int MAX_CHUNK = 4 * 1024 * 1024;
+
+static std::atomic<unsigned> load_generation(0); // Bumped to cancel the worker
+static std::atomic<int> chunks_in_flight(0);
+static std::atomic<long long> load_total(-1);     // File size once known
+
+// Applied chunks go back on a free list and the worker refills their text buffers, so a
+// load reuses the few buffers in flight instead of allocating one per chunk. Only chunks
+// of the running load are kept, and the list is emptied when it ends.
+static const size_t FREE_CHUNKS_MAX = 4;
+static std::mutex &chunk_mutex = *new std::mutex;
+static std::vector<LoadChunk *> &free_chunks = *new std::vector<LoadChunk *>;
+
+static LoadChunk *take_chunk() {
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    if (free_chunks.empty()) return new LoadChunk;
+    LoadChunk *c = free_chunks.back();
+    free_chunks.pop_back();
+    return c;
+}
+
+static void give_chunk(LoadChunk *c) {
+    c->map.reset(); // Never keep a mapping alive from the free list
+    c->text.clear();
+    c->done = false;
+    c->error = 0;
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    // Checked under the lock: release_chunks() runs after the generation is bumped
+    if (c->generation == load_generation.load() && free_chunks.size() < FREE_CHUNKS_MAX) {
+        free_chunks.push_back(c);
+    } else {
+        delete c; // Stale, finished or surplus
+    }
+}
+
+static void release_chunks() {
+    std::lock_guard<std::mutex> lock(chunk_mutex);
+    for (LoadChunk *c : free_chunks) delete c;
+    free_chunks.clear();
+}
+
+// UI thread state of the running load
+static bool busy = false;
+static bool inserting = false; // Insert File rather than Open
+static bool detecting = false; // The language is decided by the first chunk
+static int load_pos = 0;       // Where the next chunk goes
+static long long load_done = 0; // File bytes applied so far
+static std::string load_path;
+
+// --- Worker ---
+
+static void apply_load_chunk(void *data);
+
+// Hands a chunk to the UI thread with at most two in flight. False if cancelled.
+static bool post_chunk(LoadChunk *c) {
+    for (;;) {
+        if (c->generation != load_generation.load()) { give_chunk(c); return false; }
+        if (chunks_in_flight.load() < 2) {
+            chunks_in_flight++;
+            if (Fl::awake(apply_load_chunk, c) == 0) return true;
+            chunks_in_flight--; // FLTK's awake queue is full
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// Length of the whole lines at the start of [text, text + n), or n if there is no newline
+static int whole_lines(const char *text, int n) {
+    for (int i = n; i > 0; i--) {
+        if (text[i - 1] == '\n') return i;
+    }
+    return n;
+}
+
+// Opening happens here too: on a stalled network mount even open() can block
+static void load_worker(std::string path, unsigned generation) {
+    std::shared_ptr<MappedFile> map = MappedFile::open(path.c_str());
+    FILE *fp = nullptr;
+    int err = 0;
+    if (map) {
+        load_total = map->size;
+    } else if (!(fp = fopen(path.c_str(), "rb"))) {
+        err = errno; // Not mappable (pipe, device, ...) and not readable either
+    }
+
+    int chunk = FIRST_CHUNK;
+    int offset = 0;
+    while (!err && generation == load_generation.load()) {
+        LoadChunk *c = take_chunk();
+        c->generation = generation;
+        c->offset = offset;
+        int n;
+        if (map) {
+            n = map->size - offset < chunk ? map->size - offset : chunk;
+            // Whole lines where possible; the copy also faults the pages in here, not on the UI thread
+            if (offset + n < map->size) n = whole_lines(map->data + offset, n);
+            c->map = map;
+            c->text.assign(map->data + offset, map->data + offset + n);
+        } else {
+            c->text.resize(chunk);
+            n = (int)fread(c->text.data(), 1, chunk, fp);
+            if (n < chunk && ferror(fp)) err = errno ? errno : EIO;
+            if (n > 0 && (long long)offset + n >= 0x7fffffff) { n = 0; err = EFBIG; } // Buffer positions are ints
+            c->text.resize(n);
+        }
+        if (n == 0) { give_chunk(c); break; }
+        c->text.push_back('\0');
+        offset += n;
+        if (!post_chunk(c)) break;
+        if (chunk < MAX_CHUNK) chunk *= 4;
+    }
+    if (fp) fclose(fp);
+
+    LoadChunk *end = take_chunk();
+    end->generation = generation;
+    end->offset = offset;
+    end->done = true;
+    end->error = err;
+    post_chunk(end);
+}
+
+// --- UI Thread ---
+
+// Ends the load: 'err' is the read error, if any; 'complete' is false if it stopped early
+static void load_finish(int err, bool complete) {
+    busy = false;
+    load_generation++; // Stops the worker if it is still reading
+    loading = 0;
+    release_chunks(); // Chunks still in flight are freed as they arrive
+    if (inserting) {
+        journal.end_group();
+        if (load_done > 0) changed = 1;
+    } else {
+        journal.clear(); // A freshly loaded document has no history
+        changed = 0;
+        if (!complete) {
+            // Saving a partial copy over the file would lose its tail; keep it as a new document
+            // (one with no journal: there is no saved file its edits could be replayed onto)
+            filename[0] = '\0';
+            changed = load_done > 0;
+            watch_file();
+        } else {
+            watch_file(load_done); // Before any prompt: the file may grow while it is up
+            recover_or_start_journal();
+        }
+    }
+    textbuf.call_modify_callbacks(); // Update titles
+    if (err) fl_alert("Error reading from file \'%s\':\n%s.", load_path.c_str(), strerror(err));
+}
+
+static void append_chunk(LoadChunk *c) {
+    PerfScope timer(PERF_LOAD_FILE, (long long)c->text.size() - 1);
+    int len = (int)c->text.size() - 1;
+    int before = textbuf.length();
+    // Room for the rest of the file (or, its size unknown, as much again as is in), so
+    // textbuf is not moved as a whole for every chunk
+    long long rest = load_total.load() - load_done;
+    long long room = rest >= len ? rest : (long long)before + len;
+    textbuf.reserve(load_pos, room < INT_MAX ? (int)room : INT_MAX);
+    if (inserting) {
+        textbuf.insert(load_pos, c->text.data()); // Mirrored, journalled and styled as usual
+    } else {
+        if (detecting) { // The extension said nothing: go by the first bytes, before they are styled
+            language = &Language::detect(c->text.data(), len, load_total.load());
+            detecting = false;
+        }
+        // The document takes the text first, straight from the mapping when there is one,
+        // so the restyle that the textbuf insert triggers already sees it
+        if (c->map) document.insert(load_pos, c->map, c->offset, len);
+        else document.insert(load_pos, c->text.data(), len);
+        swapping = 1;
+        textbuf.insert(load_pos, c->text.data());
+        swapping = 0;
+        int got = textbuf.length() - before;
+        if (got < len) document.remove(load_pos + got, len - got); // FLTK stopped at an embedded NUL
+    }
+    load_pos += textbuf.length() - before;
+    load_done += len;
+    damage_titles(); // Progress
+}
+
+static void apply_load_chunk(void *data) {
+    LoadChunk *c = (LoadChunk *)data;
+    chunks_in_flight--;
+    if (busy && c->generation == load_generation.load()) {
+        if (c->done) load_finish(c->error, c->error == 0);
+        else append_chunk(c);
+    }
+    give_chunk(c);
+}
+
+void load_cancel() {
+    if (busy) load_finish(0, false);
+}
+
+bool load_busy() {
+    return busy;
+}
+
+int load_progress() {
+    long long total = load_total.load();
+    if (!busy || total <= 0) return -1;
+    return (int)(load_done * 100 / total);
+}
+
+// Starts loading (or inserting) a file; the text streams in over the next event loop turns
+void load_file(const char *newfile, int ipos) {
+    load_cancel();
+    save_wait(); // The save's result belongs to the document it was started on
+    busy = true;
+    loading = 1; // Prevent changed_cb from setting 'changed' flag during load
+    inserting = (ipos != -1);
+    load_path = newfile;
+    load_total = -1;
+    load_done = 0;
+
+    if (inserting) {
+        load_pos = ipos;
+        journal.begin_group(); // The whole insert undoes in one step
+    } else {
+        strncpy(filename, newfile, sizeof(filename) - 1); // Update global filename only when replacing
+        filename[sizeof(filename) - 1] = '\0';
+        load_pos = 0;
+        document.clear(); // First: the restyle of the emptied textbuf reads the document
+        swapping = 1;
+        textbuf.text("");
+        swapping = 0;
+        journal.clear();
+        crash_journal.stop(); // The old document was saved or discarded
+        const Language *by_name = Language::for_path(newfile);
+        language = by_name ? by_name : &Language::cpp();
+        detecting = !by_name;
+        style_rebuild(); // Resets the line state table for the empty document
+    }
+    textbuf.call_modify_callbacks(); // Title shows the load
+
+    std::thread(load_worker, load_path, load_generation.load()).detach();
+}
@@ -0,0 +1,14 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+// --- Streaming File Loader (Declarations) ---
+// Files are read on a worker thread in chunks that grow from one screenful to a few
+// megabytes, and the UI thread appends each one to textbuf as it arrives, so the first
+// screen shows at once and no view ever waits for the whole file. While a load runs
+// the document is read-only; Escape in any view stops it.
+void load_file(const char *newfile, int ipos = -1); // Open (ipos == -1) or Insert File at ipos; returns at once
+void load_cancel(); // Stops the running load, keeping what has arrived
+bool load_busy();   // True while a load is streaming in
+int load_progress(); // Percent of the running load, or -1 if the size is unknown
+
+#endif // LOADER_H
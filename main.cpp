@@ -1,7 +1,8 @@
 #include "EditorWindow.h" // Includes FLTK headers needed for Window/Editor
 #include "globals.h"      // For global variable definitions
 #include "callbacks.h"    // For adding callbacks
-#include "utils.h"        // For new_view(), load_file()
+#include "utils.h"        // For new_view(), recover_or_start_journal()
+#include "loader.h"       // For load_file()
 #include "syntax.h"       // For syntax highlighting setup
 
 #include <FL/Fl.H>
@@ -11,16 +12,25 @@
 // These are declared 'extern' in globals.h
 int changed = 0;
 int loading = 0;
+int swapping = 0;
 char filename[256] = "";
-Fl_Text_Buffer textbuf;  // The single shared text buffer
+TextBuffer textbuf;      // The single shared text buffer
 Fl_Text_Buffer stylebuf; // The single shared style buffer
+PieceTable document;     // Piece table mirror of textbuf
+UndoJournal journal(64 * 1024 * 1024); // Undo history, capped at 64 MB
+CrashJournal crash_journal; // Unsaved edits, replayable after a crash
+LineIndex line_index; // Line numbers of textbuf, updated on every edit
+const Language *language = &Language::cpp(); // Set from the file name or contents by load_file()
 std::vector<EditorWindow*> windows; // List of open editor windows
 
 // --- Main Function ---
 int main(int argc, char **argv) {
 
+    Fl::lock(); // Enable Fl::awake() from the background highlighter and loader threads
+
     // --- Initialize Shared Buffers ---
-    textbuf.canUndo(1); // Enable undo for the text buffer
+    // Undo history is kept by 'journal'; FLTK's own single-level undo stays off
+    textbuf.canUndo(0);
     // Style buffer undo is complex to sync reliably, rely on re-parse instead
     // stylebuf.canUndo(1);
 
@@ -29,6 +39,13 @@ int main(int argc, char **argv) {
     // Pass nullptr as user data; the callbacks will operate globally or iterate windows.
     textbuf.add_modify_callback(style_update, nullptr);
     textbuf.add_modify_callback(changed_cb, nullptr);
+    textbuf.add_modify_callback(journal_update, nullptr);
+    textbuf.add_modify_callback(recovery_update, nullptr);
+    textbuf.add_modify_callback(line_index_update, nullptr);
+    // FLTK calls the most recently added callback first, so the document mirror is
+    // registered last to be up to date before any other callback reads it, and the line
+    // index just before it so that style_update sees the new line starts.
+    textbuf.add_modify_callback(document_update, nullptr);
 
     // --- Create the First Editor View ---
     EditorWindow* first_window = new_view(); // new_view() adds itself to 'windows' vector
@@ -39,14 +56,17 @@ int main(int argc, char **argv) {
 
     // --- Load File from Command Line (if provided) ---
     if (argc > 1) {
-        load_file(argv[1]); // load_file handles styling and title updates
+        load_file(argv[1]); // Streams in once the event loop runs; handles styling and titles
     } else {
          // Ensure styling and title are correct for an initial empty buffer
          textbuf.call_modify_callbacks();
+         recover_or_start_journal(); // An untitled session may have crashed
     }
 
     // --- Enter FLTK Event Loop ---
     // Fl::run() returns when the last window is closed
-    return Fl::run();
+    int result = Fl::run();
+    crash_journal.stop(); // A clean exit leaves nothing to recover
+    return result;
 }
 
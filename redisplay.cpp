@@ -0,0 +1,102 @@
+#include "redisplay.h"
+#include "globals.h" // For windows, textbuf
+#include "utils.h"   // For set_title
+#include "Perf.h"
+
+#include <FL/Fl.H>
+#include <vector>
+#include <utility>
+
+// --- Pending Damage ---
+// Disjoint, sorted buffer ranges. Past MAX_RANGES the closest neighbours are merged, so
+// the list stays short however many small ranges arrive in one turn.
+static const size_t MAX_RANGES = 8;
+static std::vector<std::pair<int, int>> pending;
+static bool titles_pending = false;
+static bool status_pending = false;
+static bool flush_scheduled = false;
+
+static void flush_check(void *) {
+    damage_flush();
+}
+
+static void schedule() {
+    if (flush_scheduled) return;
+    flush_scheduled = true;
+    Fl::add_check(flush_check);
+}
+
+void damage_range(int start, int end) {
+    if (end <= start) return;
+    // Absorb every range that overlaps or touches the new one
+    size_t i = 0;
+    while (i < pending.size() && pending[i].second < start) i++;
+    size_t j = i;
+    while (j < pending.size() && pending[j].first <= end) {
+        if (pending[j].first < start) start = pending[j].first;
+        if (pending[j].second > end) end = pending[j].second;
+        j++;
+    }
+    pending.erase(pending.begin() + i, pending.begin() + j);
+    pending.insert(pending.begin() + i, std::make_pair(start, end));
+
+    if (pending.size() > MAX_RANGES) {
+        size_t best = 0; // Merge the pair separated by the smallest gap
+        for (size_t k = 1; k + 1 < pending.size(); k++) {
+            if (pending[k + 1].first - pending[k].second < pending[best + 1].first - pending[best].second) best = k;
+        }
+        pending[best].second = pending[best + 1].second;
+        pending.erase(pending.begin() + best + 1);
+    }
+    schedule();
+}
+
+void damage_edit(int pos, int nInserted, int nDeleted) {
+    int delta = nInserted - nDeleted;
+    auto map = [&](int x) {
+        if (x <= pos) return x;
+        return x >= pos + nDeleted ? x + delta : pos;
+    };
+    for (size_t i = 0; i < pending.size(); ) {
+        pending[i].first = map(pending[i].first);
+        pending[i].second = map(pending[i].second);
+        if (pending[i].second <= pending[i].first) pending.erase(pending.begin() + i); // Text is gone
+        else i++;
+    }
+}
+
+void damage_titles() {
+    titles_pending = true;
+    schedule();
+}
+
+void damage_status() {
+    status_pending = true;
+    schedule();
+}
+
+void damage_flush() {
+    PerfScope timer(PERF_REDISPLAY);
+    if (flush_scheduled) {
+        flush_scheduled = false;
+        Fl::remove_check(flush_check);
+    }
+    int length = textbuf.length();
+    for (EditorWindow* w : windows) {
+        if (!w) continue;
+        if (titles_pending) set_title(w);
+        if (!w->editor) continue;
+        if (status_pending) w->update_status();
+        // Only the part of each range inside this view's visible lines needs repainting
+        int first = w->editor->first_visible(), last = w->editor->last_visible();
+        for (const std::pair<int, int> &r : pending) {
+            int start = r.first > first ? r.first : first;
+            int end = r.second < last ? r.second : last;
+            if (end > length) end = length;
+            if (start <= end) w->editor->redisplay_range(start, end);
+        }
+    }
+    pending.clear();
+    titles_pending = false;
+    status_pending = false;
+}
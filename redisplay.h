@@ -0,0 +1,14 @@
+#ifndef REDISPLAY_H
+#define REDISPLAY_H
+
+// --- Coalesced Redisplay (Declarations) ---
+// Style repaints and title updates are collected while an event is handled and applied
+// once per event loop turn, so a burst of edits or highlight chunks costs each view a
+// single redisplay of only what it actually shows.
+void damage_range(int start, int end); // Styles of buffer range [start, end) changed
+void damage_edit(int pos, int nInserted, int nDeleted); // Moves pending ranges past a textbuf edit
+void damage_titles(); // Window titles may be out of date
+void damage_status(); // Line:column displays may be out of date (cursor moved or text changed)
+void damage_flush(); // Applies pending damage now (otherwise done before the next wait)
+
+#endif // REDISPLAY_H
@@ -0,0 +1,247 @@
+#include "saver.h"
+#include "globals.h"   // For document, filename, changed, textbuf
+#include "redisplay.h" // For damage_titles (the title shows the save)
+#include "loader.h"    // Saving waits for a load to finish
+#include "syntax.h"    // For style_set_language
+#include "watcher.h"   // For watch_file, watch_detach_if_rewritten
+#include "Perf.h"
+
+#include <FL/Fl.H>
+#include <FL/fl_ask.H>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <cerrno>
+#include <cstdint> // For uintptr_t
+#include <cstdio>  // For rename, remove
+#include <cstdlib> // For realpath, free
+#include <cstring> // For strerror, memcpy
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// --- Save State ---
+// One save runs at a time. The worker fills in 'error' and sets 'finished'; the UI thread
+// applies the result either from the Fl::awake() message or from save_wait().
+
+namespace {
+struct SaveJob {
+    PieceSnapshot snap;
+    std::string path;   // Name the user gave
+    std::string target; // File actually replaced (symlinks resolved)
+    unsigned id;        // Tells the Fl::awake() message of this save from a later one
+    int mode = 0666;    // Permissions for the new file
+    long long uid = -1, gid = -1; // Owner of the file being replaced (-1: a new file)
+    bool owner_lost = false; // The replacement could only be given our own user or group
+    long long journal_mark; // Crash journal position of the snapshot: later edits stay journalled
+    int error = 0;
+    bool finished = false;
+};
+}
+
+static std::mutex &save_mutex = *new std::mutex;
+static std::condition_variable &save_cv = *new std::condition_variable;
+static SaveJob *job = nullptr; // Running or finished-but-not-applied save (UI thread owns the pointer)
+static unsigned next_id = 0;
+
+static const size_t WRITE_BLOCK = 1 << 20; // Bytes per write(); aligned to the page size
+
+#ifndef _WIN32
+
+// Writes the snapshot to 'fd' in whole WRITE_BLOCK writes from a page aligned buffer
+static int write_snapshot(int fd, const PieceSnapshot &snap) {
+    void *mem = nullptr;
+    if (posix_memalign(&mem, 4096, WRITE_BLOCK) != 0) return ENOMEM;
+    char *buf = (char *)mem;
+    size_t used = 0;
+    int err = 0;
+    auto flush = [&]() {
+        for (size_t done = 0; done < used && !err; ) {
+            ssize_t w = write(fd, buf + done, used - done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w < 0) err = errno;
+            else done += (size_t)w;
+        }
+        used = 0;
+    };
+    snap.for_each_chunk(0, snap.length(), [&](const char *chunk, int len) {
+        while (len > 0 && !err) {
+            size_t n = WRITE_BLOCK - used < (size_t)len ? WRITE_BLOCK - used : (size_t)len;
+            memcpy(buf + used, chunk, n);
+            used += n; chunk += n; len -= (int)n;
+            if (used == WRITE_BLOCK) flush();
+        }
+    });
+    if (!err) flush();
+    free(mem);
+    return err;
+}
+
+// Temporary file next to the target, same owner and permissions, fsync, rename, fsync
+// the directory. The rename replaces the name, not the file: a symlink was resolved to
+// its target beforehand and keeps pointing at it, but other hard links to the old file
+// keep the old contents.
+static int write_atomically(SaveJob &j) {
+    std::string tmp = j.target + ".XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if (fd < 0) return errno;
+
+    int err = 0;
+    // Only root can give a file away; otherwise at least the group is kept if we are in it
+    if (j.uid >= 0 && (j.uid != (long long)geteuid() || j.gid != (long long)getegid()) &&
+        fchown(fd, (uid_t)j.uid, (gid_t)j.gid) != 0) {
+        bool group_kept = fchown(fd, (uid_t)-1, (gid_t)j.gid) == 0;
+        j.owner_lost = j.uid != (long long)geteuid() || !group_kept;
+    }
+    if (fchmod(fd, (mode_t)j.mode) != 0) err = errno; // mkstemp() creates it private; after fchown(), which clears set-id bits
+
+    if (!err) err = write_snapshot(fd, j.snap);
+    if (!err && fsync(fd) != 0) err = errno;
+    if (close(fd) != 0 && !err) err = errno;
+    if (!err && rename(tmp.c_str(), j.target.c_str()) != 0) err = errno;
+    if (err) {
+        unlink(tmp.c_str());
+        return err;
+    }
+    // Make the rename itself durable
+    size_t slash = j.target.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : j.target.substr(0, slash);
+    int dfd = open(dir.c_str(), O_RDONLY);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return 0;
+}
+
+static std::string resolve_target(const std::string &path) {
+    char *real = realpath(path.c_str(), nullptr);
+    if (!real) return path; // New file
+    std::string r = real;
+    free(real);
+    return r;
+}
+
+// Owner and permissions of the file being replaced, or the default mode for a new file
+static void target_attributes(SaveJob *j) {
+    struct stat st;
+    if (stat(j->target.c_str(), &st) == 0) {
+        j->mode = st.st_mode & 07777;
+        j->uid = st.st_uid;
+        j->gid = st.st_gid;
+        return;
+    }
+    mode_t mask = umask(0);
+    umask(mask);
+    j->mode = 0666 & ~mask;
+}
+
+#else // No POSIX file API: write the temporary file with stdio and swap it in
+
+static int write_atomically(SaveJob &j) {
+    std::string tmp = j.target + ".save-tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (!fp) return errno;
+    int err = 0;
+    j.snap.for_each_chunk(0, j.snap.length(), [&](const char *chunk, int len) {
+        if (!err && fwrite(chunk, 1, len, fp) != (size_t)len) err = errno ? errno : EIO;
+    });
+    if (fclose(fp) != 0 && !err) err = errno;
+    if (!err) {
+        remove(j.target.c_str()); // rename() does not replace on Windows
+        if (rename(tmp.c_str(), j.target.c_str()) != 0) err = errno;
+    }
+    if (err) remove(tmp.c_str());
+    return err;
+}
+
+static std::string resolve_target(const std::string &path) {
+    return path;
+}
+
+static void target_attributes(SaveJob *) {}
+
+#endif
+
+// --- Completion (UI thread) ---
+
+static void apply_result() {
+    SaveJob *j = job;
+    job = nullptr;
+    if (j->error) {
+        fl_alert("Error writing to file \'%s\':\n%s.", j->path.c_str(), strerror(j->error));
+    } else {
+        strncpy(filename, j->path.c_str(), sizeof(filename) - 1); // Update global filename
+        filename[sizeof(filename) - 1] = '\0';
+        watch_file(); // The file as written is the document's version from now on
+        if (j->snap.same_as(document.snapshot())) changed = 0; // Edits made during the write stay unsaved
+        crash_journal.start(filename, j->journal_mark); // Now relative to the file just written
+        style_set_language(Language::for_path(filename)); // Save As may have changed the extension
+        if (j->owner_lost) {
+            fl_alert("\'%s\' was saved, but its owner or group could not be kept:\nit now belongs to you.", j->path.c_str());
+        }
+    }
+    delete j;
+    textbuf.call_modify_callbacks(); // Update titles in all windows
+}
+
+static void save_done(void *data) {
+    if (job && job->id == (unsigned)(uintptr_t)data) apply_result(); // Otherwise save_wait() already did
+}
+
+static void save_worker(SaveJob *j) {
+    void *id = (void *)(uintptr_t)j->id; // 'j' may be gone once the UI has seen 'finished'
+    int err;
+    {
+        PerfScope timer(PERF_SAVE_FILE, j->snap.length());
+        err = write_atomically(*j);
+    }
+    {
+        std::lock_guard<std::mutex> lock(save_mutex);
+        j->error = err;
+        j->finished = true;
+    }
+    save_cv.notify_all();
+    while (Fl::awake(save_done, id) != 0) { // FLTK's awake queue is full
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool save_busy() {
+    return job != nullptr;
+}
+
+void save_wait() {
+    if (!job) return;
+    {
+        std::unique_lock<std::mutex> lock(save_mutex);
+        save_cv.wait(lock, [] { return job->finished; });
+    }
+    apply_result();
+}
+
+// Starts saving the document to 'newfile'; the title shows the save until it completes
+void save_file(const char *newfile) {
+    if (load_busy()) { // Only part of the file is in the buffer yet
+        fl_alert("\'%s\' is still loading.\nWait for it to finish, or press Escape to stop it.", filename);
+        return;
+    }
+    save_wait(); // One save at a time, in order
+    // The snapshot may share text with the mapped file; if another program has rewritten it
+    // in place since it was loaded, that text is no longer the document's
+    watch_detach_if_rewritten();
+
+    job = new SaveJob;
+    job->snap = document.snapshot(); // The document is immutable under a snapshot; editing goes on
+    job->path = newfile;
+    job->target = resolve_target(newfile);
+    target_attributes(job);
+    job->id = ++next_id;
+    job->journal_mark = crash_journal.mark();
+    std::thread(save_worker, job).detach();
+    damage_titles();
+}
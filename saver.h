@@ -0,0 +1,16 @@
+#ifndef SAVER_H
+#define SAVER_H
+
+// --- Background Saver (Declarations) ---
+// Saving takes a snapshot of the document and returns; a worker thread writes the
+// snapshot to a temporary file next to the target, flushes it to disk and renames it
+// over the target, so a crash or a full disk never leaves a half-written file behind.
+// The new file gets the old one's permissions (or the save fails) and, where allowed, its
+// owner and group (the user is told if not). Saving through a symlink replaces the file
+// it points to; other hard links to the old file are left with the old text.
+// 'filename', 'changed' and the titles are updated when the write has completed.
+void save_file(const char *newfile);
+bool save_busy(); // True while a save is being written
+void save_wait(); // Blocks until the running save (if any) has completed and been applied
+
+#endif // SAVER_H
@@ -1,12 +1,27 @@
 #include "syntax.h"
-#include "globals.h" // Access to textbuf, stylebuf, windows vector
-#include "EditorWindow.h" // Needed to call redisplay_range on editor
+#include "globals.h" // Access to textbuf, stylebuf, line_index, language, windows vector
+#include "redisplay.h"    // Queues repaints of restyled ranges
+#include "Language.h"     // Lexer rules of the document's language
+#include "Perf.h"         // Timers on style_parse and style_update
+#include "ThreadPool.h"   // Parallel lexing of large ranges
 
+#include <FL/Fl.H>
 #include <FL/Fl_Text_Buffer.H>
-#include <cstdlib> // For bsearch, free
-#include <cstring> // For strncmp, memset, strlen
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib> // For free
+#include <cstring> // For memset, memchr
 #include <cctype>  // For isalpha, isalnum
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 // --- Syntax Highlighting Data (Definitions) ---
 Fl_Text_Display::Style_Table_Entry styletable[] = {
   { FL_BLACK,      FL_COURIER,        14 }, // A - Plain
@@ -15,220 +30,911 @@ Fl_Text_Display::Style_Table_Entry styletable[] = {
   { FL_BLUE,       FL_COURIER,        14 }, // D - Strings ("...")
   { FL_DARK_RED,   FL_COURIER,        14 }, // E - Directives (#...)
   { FL_DARK_RED,   FL_COURIER_BOLD,   14 }, // F - Types (Fl_..., etc.)
-  { FL_BLUE,       FL_COURIER_BOLD,   14 }  // G - Keywords (if, else, etc.)
+  { FL_BLUE,       FL_COURIER_BOLD,   14 }, // G - Keywords (if, else, etc.)
+  { FL_DARK_GREEN, FL_COURIER_ITALIC, 14 }  // H - Block comments of the second kind (''' ''')
 };
 // Define the table size variable here (removed const)
 int styletable_size = sizeof(styletable) / sizeof(styletable[0]);
 
-const char *code_keywords[] = {
-  "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break",
-  "case", "catch", "char", "class", "compl", "const", "const_cast",
-  "continue", "default", "delete", "do", "double", "dynamic_cast", "else",
-  "enum", "explicit", "export", "extern", "false", "float", "for",
-  "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace",
-  "new", "not", "not_eq", "operator", "or", "or_eq", "private",
-  "protected", "public", "register", "reinterpret_cast", "return",
-  "short", "signed", "sizeof", "static", "static_cast", "struct",
-  "switch", "template", "this", "throw", "true", "try", "typedef",
-  "typeid", "typename", "union", "unsigned", "using", "virtual", "void",
-  "volatile", "wchar_t", "while", "xor", "xor_eq"
-};
-const int num_keywords = sizeof(code_keywords) / sizeof(code_keywords[0]);
-
-const char *code_types[] = {
-  "Fl_Widget", "Fl_Window", "Fl_Double_Window", "Fl_Gl_Window",
-  "Fl_Button", "Fl_Input", "Fl_Text_Editor", "Fl_Text_Buffer",
-  "Fl_Menu_Bar", "Fl_File_Chooser"
-  // Add more C++ standard types or FLTK types if desired
-  // "int", "char", "double", "float", "void", "bool", "long", "short", etc.
-};
-const int num_types = sizeof(code_types) / sizeof(code_types[0]);
-
 
 // --- Syntax Highlighting Function Implementations ---
 
-// Used by bsearch to compare keywords/types
-int compare_keywords(const void *p1, const void *p2) {
-  return strcmp(*(const char **)p1, *(const char **)p2);
-}
-
-// Parses text and generates corresponding style characters
-void style_parse(const char *text, char *style, int length) {
-  char             current_style_char;
-  int              col;
-  int              last_char_alnum;
-  char             keyword_buf[255], *kbuf_ptr;
-  const char       *text_ptr;
-  int              i;
-  const char       **found_keyword;
-
-  if (!style || !text || length <= 0) return; // Safety check
-
-  char* style_write_ptr = style; // Use a separate pointer for writing to style buffer
-  current_style_char = *style_write_ptr; // Initial style context for the segment
-
-  for (col = 0, last_char_alnum = 0; length > 0; length--, text++) {
-      switch (current_style_char) {
-          case 'A': // Default style
-              if (col == 0 && *text == '#') current_style_char = 'E'; // Directive
-              else if (strncmp(text, "//", 2) == 0) current_style_char = 'B'; // Line comment
-              else if (strncmp(text, "/*", 2) == 0) current_style_char = 'C'; // Block comment start
-              else if (strncmp(text, "\\\"", 2) == 0) { // Escaped quote
-                  if (length >= 2) { *style_write_ptr++ = current_style_char; *style_write_ptr++ = current_style_char; text++; length--; col += 2; }
-                  else { *style_write_ptr++ = current_style_char; col++; } // Handle single char at end
-                  if (length <= 1) { length = 0; } continue; // Consume chars, continue loop
-              } else if (*text == '\"') current_style_char = 'D'; // String start
-              else if (!last_char_alnum && isalpha(*text)) { // Potential keyword/type start
-                  for (text_ptr = text, kbuf_ptr = keyword_buf; (isalnum(*text_ptr) || *text_ptr == '_') && kbuf_ptr < (keyword_buf + sizeof(keyword_buf) - 1); *kbuf_ptr++ = *text_ptr++);
-                  *kbuf_ptr = '\0'; kbuf_ptr = keyword_buf; char matched_style = 'A';
-                  found_keyword = (const char **)bsearch(&kbuf_ptr, code_types, num_types, sizeof(code_types[0]), compare_keywords);
-                  if (found_keyword != NULL) matched_style = 'F'; // Type
-                  else {
-                      found_keyword = (const char **)bsearch(&kbuf_ptr, code_keywords, num_keywords, sizeof(code_keywords[0]), compare_keywords);
-                      if (found_keyword != NULL) matched_style = 'G'; // Keyword
-                  }
-                  if (matched_style != 'A') {
-                      int keyword_len = (int)strlen(keyword_buf);
-                      for (i = 0; i < keyword_len; i++) *style_write_ptr++ = matched_style;
-                      text += keyword_len - 1; length -= keyword_len -1; col += keyword_len;
-                      last_char_alnum = 1; current_style_char = 'A'; continue; // Consume keyword, continue loop
+static inline int is_ident(char c) { return isalnum((unsigned char)c) || c == '_'; }
+
+// True if 'text' (of 'length' bytes) starts with the non-empty 'token'
+static inline bool starts_with(const char *text, int length, const char *token) {
+  if (!*token) return false;
+  int i = 0;
+  for (; token[i]; i++) {
+    if (i >= length || text[i] != token[i]) return false;
+  }
+  return true;
+}
+
+// Last byte of text[from, to) that is not a blank, or 'none' if there is none
+static inline char last_solid(const char *text, int from, int to, char none) {
+  while (to > from && (text[to - 1] == ' ' || text[to - 1] == '\t')) to--;
+  return to > from ? text[to - 1] : none;
+}
+
+// --- Lexer Fast Path ---
+// Most bytes cannot change the lexer state: in C++, anything but '*' inside a block
+// comment, anything but '\\' and '"' inside a string, anything but '\n' in a line comment
+// or directive, and whitespace and punctuation other than / \\ " # in plain text. Each
+// language's compiled tables list those stop bytes per state (Language::stop_set()).
+// lex_skip() finds the end of such a run 16 or 32 bytes at a time (SSE2/AVX2 where the
+// compiler targets them, scalar otherwise) so style_parse() can style it in one go.
+
+#if defined(__AVX2__)
+typedef __m256i lex_vec;
+static const int LEX_VEC = 32;
+static inline lex_vec lex_load(const char *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline lex_vec lex_set(char c) { return _mm256_set1_epi8(c); }
+static inline lex_vec lex_eq(lex_vec a, lex_vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline lex_vec lex_gt(lex_vec a, lex_vec b) { return _mm256_cmpgt_epi8(a, b); }
+static inline lex_vec lex_or(lex_vec a, lex_vec b) { return _mm256_or_si256(a, b); }
+static inline lex_vec lex_and(lex_vec a, lex_vec b) { return _mm256_and_si256(a, b); }
+static inline unsigned lex_mask(lex_vec a) { return (unsigned)_mm256_movemask_epi8(a); }
+#elif defined(__SSE2__)
+typedef __m128i lex_vec;
+static const int LEX_VEC = 16;
+static inline lex_vec lex_load(const char *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline lex_vec lex_set(char c) { return _mm_set1_epi8(c); }
+static inline lex_vec lex_eq(lex_vec a, lex_vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline lex_vec lex_gt(lex_vec a, lex_vec b) { return _mm_cmpgt_epi8(a, b); }
+static inline lex_vec lex_or(lex_vec a, lex_vec b) { return _mm_or_si128(a, b); }
+static inline lex_vec lex_and(lex_vec a, lex_vec b) { return _mm_and_si128(a, b); }
+static inline unsigned lex_mask(lex_vec a) { return (unsigned)_mm_movemask_epi8(a); }
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+// Bit i set where v[i] is an identifier character or a byte >= 0x80 (signed compares:
+// those are negative)
+static inline unsigned lex_word_mask(lex_vec v) {
+  lex_vec lower = lex_or(v, lex_set(0x20)); // Folds A-Z onto a-z
+  lex_vec letter = lex_and(lex_gt(lower, lex_set('a' - 1)), lex_gt(lex_set('z' + 1), lower));
+  lex_vec digit = lex_and(lex_gt(v, lex_set('0' - 1)), lex_gt(lex_set('9' + 1), v));
+  return lex_mask(lex_or(lex_or(letter, digit), lex_eq(v, lex_set('_')))) | lex_mask(v);
+}
+#endif
+
+int style_scalar = 0; // The bench checks that both ways style alike
+
+// Length of the leading run of text[0, length) that lexer state 'state' passes through
+// unchanged; *last_nl receives the offset of the run's last '\n', or -1 if it has none.
+static int lex_skip(const Language &lang, const char *text, int length, char state, int *last_nl) {
+  int i = 0;
+  *last_nl = -1;
+#if defined(__AVX2__) || defined(__SSE2__)
+  const Language::Stops &stops = lang.stop_set(state);
+  lex_vec stop_vec[sizeof(stops.chars)];
+  for (int k = 0; k < stops.count; k++) stop_vec[k] = lex_set(stops.chars[k]);
+  const lex_vec newline = lex_set('\n');
+  for (; !style_scalar && i + LEX_VEC <= length; i += LEX_VEC) {
+    lex_vec v = lex_load(text + i);
+    unsigned stop = stops.words ? lex_word_mask(v) : 0;
+    if (stops.count > 0) {
+      lex_vec hit = lex_eq(v, stop_vec[0]);
+      for (int k = 1; k < stops.count; k++) hit = lex_or(hit, lex_eq(v, stop_vec[k]));
+      stop |= lex_mask(hit);
+    }
+    unsigned nl = lex_mask(lex_eq(v, newline));
+    if (stop) nl &= (1u << __builtin_ctz(stop)) - 1; // Newlines before the stop only
+    if (nl) *last_nl = i + 31 - __builtin_clz(nl);
+    if (stop) return i + __builtin_ctz(stop);
+  }
+#endif
+  for (; i < length && !lang.stops(state, text[i]); i++) {
+    if (text[i] == '\n') *last_nl = i;
+  }
+  return i;
+}
+
+// Parses text and generates corresponding style characters, with the rules of 'lang'
+// (the document's language when nullptr). 'state' is the lexer state at text[0], which
+// must be a line start unless it is 'A'; returns the state after the last character.
+char style_parse(const char *text, char *style, int length, char state, const Language *lang) {
+  if (!style || !text || length <= 0) return state; // Safety check
+  if (!lang) lang = language;
+  PerfScope timer(PERF_STYLE_PARSE, length);
+  if (lang->is_plain()) { // Nothing to lex
+    memset(style, 'A', length);
+    return 'A';
+  }
+  const LanguageRules &rules = lang->rules();
+  int block_open = (int)strlen(rules.block_open), block_close = (int)strlen(rules.block_close);
+  int block_alt = (int)strlen(rules.block_alt);
+
+  char *out = style;          // Next style to write
+  char current = state;       // Lexer state
+  char quote = rules.quotes[0]; // Quote that ends the current string (one carried over a newline has the first)
+  int col = 0;                // Column of 'text' (only column 0 matters, for directives)
+  bool last_alnum = false;    // The previous character was part of an identifier
+  char before = '\n';         // Last non-blank byte of the line so far ('\n' at its start)
+
+  while (length > 0) {
+      // Bytes that cannot change the state are styled in bulk
+      int last_nl, run = lex_skip(*lang, text, length, current, &last_nl);
+      if (run > 0) {
+          memset(out, current, run);
+          out += run;
+          col = last_nl >= 0 ? run - last_nl - 1 : col + run;
+          last_alnum = is_ident(text[run - 1]);
+          if (rules.value_quotes) before = last_solid(text, last_nl + 1, run, last_nl >= 0 ? '\n' : before);
+          text += run; length -= run;
+          if (length <= 0) break;
+      }
+
+      // The token at 'text': 'take' bytes styled 'now', leaving the lexer in state 'next'
+      char c = *text;
+      int take = 1;
+      char now = current, next = current;
+      switch (current) {
+          case 'A': // Plain text
+              if (col == 0 && rules.directive && c == rules.directive) now = next = 'E';
+              else if (starts_with(text, length, rules.line_comment)) now = next = 'B';
+              else if (starts_with(text, length, rules.block_open)) { now = next = 'C'; take = block_open; }
+              else if (starts_with(text, length, rules.block_alt)) { now = next = 'H'; take = block_alt; }
+              else if (rules.escape && c == rules.escape && length > 1 && lang->is_quote(text[1])) take = 2; // Escaped quote
+              else if (lang->is_quote(c) && (!rules.value_quotes || strchr("\n:-,[{?", before))) { now = next = 'D'; quote = c; }
+              else if (is_ident(c)) { // Word or number: styled as a whole
+                  int word_len = 1;
+                  while (word_len < length && is_ident(text[word_len])) word_len++;
+                  char word_style = 0;
+                  if (!last_alnum && isalpha((unsigned char)c)) {
+                      if (rules.classify) word_style = rules.classify(text, word_len); // Type, keyword or 0
+                      if (!word_style && rules.colon_keys && word_len < length && text[word_len] == ':') word_style = 'F';
                   }
+                  memset(out, word_style ? word_style : 'A', word_len);
+                  out += word_len;
+                  before = text[word_len - 1];
+                  text += word_len; length -= word_len; col += word_len;
+                  last_alnum = true;
+                  continue;
               }
-              break; // End case 'A'
+              break;
 
-          case 'C': // Inside block comment
-              if (strncmp(text, "*/", 2) == 0) { // Block comment end
-                  if (length >= 2) { *style_write_ptr++ = current_style_char; *style_write_ptr++ = current_style_char; text++; length--; col += 2; current_style_char = 'A'; }
-                  else { *style_write_ptr++ = current_style_char; col++; }
-                  if (length <= 1) { length = 0; } continue; // Consume chars, continue loop
-              }
-              break; // End case 'C'
-
-          case 'D': // Inside string literal
-              if (strncmp(text, "\\\"", 2) == 0) { // Escaped quote
-                  if (length >= 2) { *style_write_ptr++ = current_style_char; *style_write_ptr++ = current_style_char; text++; length--; col += 2; }
-                  else { *style_write_ptr++ = current_style_char; col++; }
-                  if (length <= 1) { length = 0; } continue; // Consume chars, continue loop
-              } else if (*text == '\"') { // End of string
-                  *style_write_ptr++ = current_style_char; col++; current_style_char = 'A'; continue;
-              }
-              break; // End case 'D'
-      } // End switch
+          case 'C': // Inside a block comment
+              if (starts_with(text, length, rules.block_close)) { take = block_close; next = 'A'; }
+              break;
+
+          case 'H': // Inside a block comment of the second kind
+              if (starts_with(text, length, rules.block_alt)) { take = block_alt; next = 'A'; }
+              break;
 
-      // Write the determined style for the current character
-      *style_write_ptr++ = current_style_char;
-      col++;
-      last_char_alnum = isalnum(*text) || *text == '_';
+          case 'D': // Inside a string
+              if (rules.escape && c == rules.escape && length > 1 && text[1] != '\n') take = 2; // The escaped character goes along
+              else if (c == quote) next = 'A';
+              else if (c == '\n' && !rules.multiline_strings) now = next = 'A'; // Unterminated: ends with the line
+              break;
+      }
 
-      // Handle end-of-line transitions
-      if (*text == '\n') {
+      memset(out, now, take);
+      out += take;
+      col += take;
+      last_alnum = is_ident(text[take - 1]);
+      if (c != ' ' && c != '\t') before = text[take - 1];
+      current = next;
+      if (c == '\n') { // Tokens of more than one byte never hold a newline
           col = 0;
-          if (current_style_char == 'B' || current_style_char == 'E') current_style_char = 'A'; // Line comments/directives end
+          if (current == 'B' || current == 'E') current = 'A'; // Line comments and directives end
       }
-  } // End for loop
+      text += take; length -= take;
+  }
+  return current;
 }
 
 
-// Updates the style buffer based on changes in the text buffer
-void style_update(int pos, int nInserted, int nDeleted, int, const char*, void* /*cbArg*/) {
-    int start, end;
-    char *style = NULL;
-    char *text = NULL;
-    char last_style_before_parse = 'A';
-    char last_style_after_parse = 'A';
+// --- Line State Table ---
+// line_states[n] is the lexer state at the start of line n: 'A' (plain), 'C' or 'H' (inside
+// a block comment) or 'D' (inside a string). Line comments and directives always end at the
+// newline, so they never carry over. Entries for freshly inserted lines hold 0 ("unknown"),
+// which never matches a real state and so forces those lines to be re-lexed.
+// While background highlighting runs, the table only covers lines up to the frontier.
+static std::vector<char> line_states(1, 'A');
 
-    if (nInserted == 0 && nDeleted == 0) return; // Ignore selection-only changes
+// --- Background Highlighting State (UI thread) ---
+// Everything before the frontier has final styles; everything after it still holds
+// placeholder or speculative styles and is being lexed by the worker thread.
+static int highlight_pending = 0;
+static int frontier_pos = 0;  // First byte not yet finally styled (always a line start)
+static int frontier_line = 0; // Line number of frontier_pos
+static std::atomic<unsigned> highlight_generation(0); // Bumped to cancel in-flight work
+static std::atomic<int> chunks_in_flight(0);
 
-    // --- Handle buffer modification ---
-    if (nInserted > 0) {
-        style = new char[nInserted + 1];
-        memset(style, 'A', nInserted); style[nInserted] = '\0';
-        stylebuf.replace(pos, pos + nDeleted, style);
-        delete[] style; style = NULL;
-    } else {
-        stylebuf.remove(pos, pos + nDeleted);
+// Lexer state at the start of the line following a newline styled 'newline_style'
+static inline char line_entry_state(char newline_style) {
+    return (newline_style == 'C' || newline_style == 'D' || newline_style == 'H') ? newline_style : 'A';
+}
+
+// Returns contiguous text for the whole lines starting at 'pos' (at most about 'max_len'
+// bytes, but always at least one complete line), storing its length in *n. Points into the
+// snapshot's pieces when possible; lines straddling pieces are gathered into 'scratch'.
+static const char *next_lines(const PieceSnapshot &snap, int pos, int max_len,
+                              std::vector<char> &scratch, int *n) {
+    int text_len = snap.length();
+    int avail;
+    const char *text = snap.span(pos, &avail);
+    *n = avail < max_len ? avail : max_len;
+    if (pos + *n >= text_len) return text;
+
+    // Stop after the last complete line so the lexer never needs bytes beyond the chunk
+    int last_nl = *n - 1;
+    while (last_nl >= 0 && text[last_nl] != '\n') last_nl--;
+    if (last_nl >= 0) {
+        *n = last_nl + 1;
+        return text;
     }
+    // One line longer than the chunk or crossing pieces: gather it contiguously
+    scratch.clear();
+    snap.for_each_chunk(pos, text_len, [&scratch](const char *chunk, int len) {
+        if (!scratch.empty() && scratch.back() == '\n') return;
+        const char *end = (const char *)memchr(chunk, '\n', len);
+        scratch.insert(scratch.end(), chunk, end ? end + 1 : chunk + len);
+    });
+    *n = (int)scratch.size();
+    return scratch.data();
+}
 
-    // --- Determine range to re-parse ---
-    start = textbuf.line_start(pos);
-    end = textbuf.line_end(pos + nInserted);
-    int text_len = textbuf.length();
-    if (end > text_len) end = text_len;
-    int style_len = stylebuf.length();
-    int check_pos = start > 0 ? start - 1 : 0;
-
-    // Determine the style context *before* the change start position
-    char initial_style_context = 'A';
-    if (check_pos < style_len) {
-        initial_style_context = stylebuf.byte_at(check_pos);
-        // If previous char suggests a C comment, scan backwards to find the actual start or end
-        if (initial_style_context == 'C') {
-            int comment_scan_pos = start;
-            while (comment_scan_pos > 0) {
-                // Check for '*/' ending a *previous* comment block before our change start
-                if (comment_scan_pos >= 2 && textbuf.byte_at(comment_scan_pos - 1) == '/' && textbuf.byte_at(comment_scan_pos - 2) == '*') {
-                    // We are likely starting in 'A' context after a comment ended
-                    initial_style_context = 'A';
-                    break;
-                }
-                // Check for '/*' starting the comment block we are inside
-                if (comment_scan_pos >= 2 && textbuf.byte_at(comment_scan_pos - 1) == '*' && textbuf.byte_at(comment_scan_pos - 2) == '/') {
-                    // Found the start; adjust parse range start and assume 'A' context before it
-                    start = textbuf.line_start(comment_scan_pos - 2);
-                    initial_style_context = 'A'; // Context before the /* is A
+// Scratch buffers of the UI thread's lexing, reused from one edit to the next so that
+// typing does not allocate. One that grew for a big job is released once the edits have
+// moved on to much less (a long line being typed into keeps its buffer).
+static std::vector<char> &relex_styles = *new std::vector<char>;
+static std::vector<char> &relex_gather = *new std::vector<char>;
+
+static void trim_scratch(std::vector<char> &v, size_t used) {
+    const size_t SCRATCH_KEEP = 1 << 20;
+    if (v.capacity() > SCRATCH_KEEP && v.capacity() / 4 > used) std::vector<char>().swap(v);
+}
+
+// Re-lexes whole lines starting at 'start' (the beginning of line 'line') until at least
+// 'min_end' has been covered and the recomputed entry state of the next line matches the
+// stored one, or the highlight frontier is reached. Returns the end of the re-styled range.
+// The text is lexed where it lies in the document's pieces (see next_lines()).
+static int style_relex(int start, int line, int min_end) {
+    char state = line_states[line];
+    PieceSnapshot snap = document.snapshot();
+    int text_len = textbuf.length(); // The styles' length; the document may briefly hold more (see append_chunk())
+    int chunk_end = min_end;
+    int grow = 4096; // Bytes added per extra pass while the states have not converged yet
+    relex_gather.clear(); // Its size is then what this call gathered
+
+    for (;;) {
+        chunk_end = line_index.line_end(line_index.line_of(chunk_end));
+        if (chunk_end < text_len) chunk_end++; // Include the newline so the next entry state is known
+        int length = chunk_end - start;
+        if ((int)relex_styles.size() < length + 1) relex_styles.resize(length + 1);
+        char *style = relex_styles.data();
+
+        // Record entry states of the lines that start inside this chunk, stopping at the
+        // first line past the edit whose state is unchanged: everything after it is still valid.
+        // The frontier line's new state is simply recorded; the worker resumes from it.
+        int stop = chunk_end;
+        bool converged = false;
+        for (int pos = start; pos < chunk_end && !converged; ) {
+            int n;
+            const char *text = next_lines(snap, pos, chunk_end - pos, relex_gather, &n);
+            if (n > chunk_end - pos) n = chunk_end - pos; // Only while the document runs ahead of textbuf
+            char *out = style + (pos - start);
+            state = style_parse(text, out, n, state);
+            for (int i = 0; i < n; i++) {
+                if (text[i] != '\n') continue;
+                int next_line = ++line;
+                char entry = line_entry_state(out[i]);
+                if ((pos + i + 1 > min_end && line_states[next_line] == entry) ||
+                    (highlight_pending && next_line == frontier_line)) {
+                    line_states[next_line] = entry;
+                    stop = pos + i + 1;
+                    converged = true;
                     break;
                 }
-                comment_scan_pos--;
+                line_states[next_line] = entry;
             }
-            if (comment_scan_pos == 0) start = 0; // Scanned all the way back
+            pos += n;
         }
+        style[stop - start] = '\0';
+        stylebuf.replace(start, stop, style);
+
+        if (converged || chunk_end >= text_len) {
+            trim_scratch(relex_styles, length + 1);
+            trim_scratch(relex_gather, relex_gather.size());
+            return stop;
+        }
+        start = chunk_end;
+        chunk_end = start + grow;
+        if (chunk_end > text_len) chunk_end = text_len;
+        grow *= 2;
     }
+}
 
-    // --- Parse the primary affected range ---
-    text = textbuf.text_range(start, end); if (!text) goto cleanup;
-    style = stylebuf.text_range(start, end); if (!style) goto cleanup;
+// --- Background Highlighting Worker ---
+// The worker lexes a snapshot of the document off the UI thread: first the visible range
+// of every view (speculatively, assuming plain text at its first line), then the whole
+// document in order from the frontier. Finished chunks are handed to the UI thread with
+// Fl::awake(), which applies them to stylebuf and repaints. Any edit bumps the generation,
+// so stale chunks are dropped, and posts a new job from the (possibly moved) frontier.
 
-    // Get style at end *before* parsing this segment
-    style_len = stylebuf.length(); // Update style_len after potential buffer changes
-    if (end > start && end <= style_len) last_style_before_parse = stylebuf.byte_at(end - 1);
-    else if (style_len > 0 && start == end && start > 0) last_style_before_parse = stylebuf.byte_at(start - 1);
-    else last_style_before_parse = 'A';
+struct HighlightJob {
+    unsigned generation;
+    const Language *lang;
+    PieceSnapshot snap;
+    int start;     // Frontier position in 'snap'
+    int line;      // Frontier line
+    char state;    // Lexer state at 'start'
+    std::vector<int> viewports; // Pairs of [first, last) visible positions
+};
+
+struct StyleChunk {
+    unsigned generation;
+    int start;
+    int line;                 // Line number of 'start', or -1 for a speculative viewport chunk
+    std::vector<char> styles; // '\0' terminated
+    std::vector<char> states; // Entry states of the lines starting inside the chunk
+};
 
-    // Parse the segment, providing initial context
-    if (end > start) style[0] = initial_style_context;
-    style_parse(text, style, end - start);
+static std::mutex &job_mutex = *new std::mutex;
+static std::condition_variable &job_cv = *new std::condition_variable;
+static HighlightJob *next_job = nullptr;
+
+// Runs on the UI thread (via Fl::awake)
+static void apply_chunk(void *data) {
+    StyleChunk *c = (StyleChunk *)data;
+    chunks_in_flight--;
+    int n = (int)c->styles.size() - 1;
+    if (c->generation == highlight_generation.load() && highlight_pending) {
+        if (c->line < 0) {
+            // Speculative viewport styles: only ever overwrite unfinished placeholders
+            int from = c->start > frontier_pos ? c->start : frontier_pos;
+            if (from < c->start + n) {
+                stylebuf.replace(from, c->start + n, c->styles.data() + (from - c->start));
+                damage_range(from, c->start + n);
+            }
+        } else if (c->start == frontier_pos && c->line == frontier_line) {
+            stylebuf.replace(c->start, c->start + n, c->styles.data());
+            line_states.insert(line_states.end(), c->states.begin(), c->states.end());
+            frontier_pos += n;
+            frontier_line += (int)c->states.size();
+            if (frontier_pos >= textbuf.length()) highlight_pending = 0;
+            damage_range(c->start, c->start + n);
+        }
+    }
+    delete c;
+}
 
-    // Replace the style buffer segment
-    stylebuf.replace(start, end, style);
+// Hands a chunk to the UI thread, keeping only a few in flight so the worker cannot
+// run arbitrarily far ahead of the repaint. Returns false if the job was cancelled.
+static bool publish_chunk(StyleChunk *c) {
+    for (;;) {
+        if (c->generation != highlight_generation.load()) { delete c; return false; }
+        if (chunks_in_flight.load() < 4) {
+            chunks_in_flight++;
+            if (Fl::awake(apply_chunk, c) == 0) return true;
+            chunks_in_flight--; // FLTK's awake queue is full
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
 
-    // Get style at end *after* parsing
-    if (end > start) last_style_after_parse = style[end - start - 1];
-    else last_style_after_parse = initial_style_context;
+// --- Parallel Lexing ---
+// A large range is cut at line starts into a batch of chunks that are lexed at once on
+// the thread pool, each assuming plain text at its first line (true almost everywhere in
+// real code). They are then stitched in order: where the state the previous chunk really
+// ends in differs from that guess, the chunk is re-lexed from the true state line group
+// by line group until a line's recomputed entry state matches the speculative one. From
+// that line on the speculative styles are exactly what a sequential pass would produce,
+// since the lexer state at a line start determines everything after it.
 
-    // --- Check if reparsing the rest of the buffer is needed ---
-    if (last_style_after_parse != last_style_before_parse || last_style_after_parse == 'C') {
-        int rest_start = end; int rest_end = textbuf.length();
-        if (rest_start < rest_end) {
-            free(text); text = NULL; free(style); style = NULL;
-            text = textbuf.text_range(rest_start, rest_end); if (!text) goto cleanup;
-            style = stylebuf.text_range(rest_start, rest_end); if (!style) goto cleanup;
+static const int MIN_LEX_CHUNK = 64 * 1024; // Smaller chunks are not worth a thread
 
-            // Parse the remainder, starting with the context from the previous section
-            if (rest_end > rest_start) style[0] = last_style_after_parse;
-            style_parse(text, style, rest_end - rest_start);
+// Start of the line after the one holding 'pos' (or 'end', whichever comes first)
+static int next_line_start(const PieceSnapshot &snap, int pos, int end) {
+    int found = end;
+    snap.for_each_chunk(pos, end, [&](const char *chunk, int len) {
+        if (found < end) return;
+        const char *nl = (const char *)memchr(chunk, '\n', len);
+        if (nl) found = pos + (int)(nl - chunk) + 1;
+        else pos += len;
+    });
+    return found;
+}
 
-            stylebuf.replace(rest_start, rest_end, style);
-            end = rest_end; // Update end to cover the re-parsed section for redisplay
+// Lexes the whole lines of [start, end) from 'state' into c.styles and c.states.
+// Returns the state at 'end'.
+static char lex_chunk(const Language &lang, const PieceSnapshot &snap, int start, int end, char state,
+                      StyleChunk &c, std::vector<char> &scratch) {
+    c.styles.resize(end - start + 1);
+    for (int pos = start; pos < end; ) {
+        int n;
+        const char *text = next_lines(snap, pos, end - pos, scratch, &n);
+        char *style = c.styles.data() + (pos - start);
+        state = style_parse(text, style, n, state, &lang);
+        for (int i = 0; i < n; i++) {
+            if (text[i] == '\n') c.states.push_back(line_entry_state(style[i]));
         }
+        pos += n;
     }
+    c.styles[end - start] = '\0';
+    return state;
+}
+
+// Re-lexes chunk 'c' (lexed assuming 'A') from its true entry state until the line entry
+// states converge. Returns the state at its end, or 'spec_end' if they converged.
+static char restitch_chunk(const Language &lang, const PieceSnapshot &snap, StyleChunk &c, char state,
+                           char spec_end, std::vector<char> &scratch) {
+    int end = c.start + (int)c.styles.size() - 1;
+    size_t line = 0;
+    int grow = 4096; // Bytes re-lexed per pass, doubled while the states still differ
+    for (int pos = c.start; pos < end; grow *= 2) {
+        int n;
+        const char *text = next_lines(snap, pos, grow < end - pos ? grow : end - pos, scratch, &n);
+        char *style = c.styles.data() + (pos - c.start);
+        state = style_parse(text, style, n, state, &lang);
+        bool converged = false;
+        for (int i = 0; i < n; i++) {
+            if (text[i] != '\n') continue;
+            char entry = line_entry_state(style[i]);
+            if (entry == c.states[line]) converged = true; // The rest of the pass matches too
+            c.states[line++] = entry;
+        }
+        if (converged) return spec_end;
+        pos += n;
+    }
+    return state;
+}
+
+// Lexes about count * chunk_len bytes of [start, end) of 'snap', where 'start' is a line
+// start in lexer state 'state', into 'out' (consecutive chunks in order, owned by the
+// caller). Chunk lines are numbered from 'line', or left at -1 if 'line' is negative.
+// Returns the lexer state after the last chunk.
+static char lex_batch(const Language &lang, const PieceSnapshot &snap, int start, int end, int line,
+                      char state, int chunk_len, int count, std::vector<StyleChunk *> &out) {
+    std::vector<int> bounds(1, start);
+    while (bounds.back() < end && (int)bounds.size() <= count) {
+        int at = bounds.back();
+        bounds.push_back(end - at <= chunk_len ? end : next_line_start(snap, at + chunk_len - 1, end));
+    }
+    int chunks = (int)bounds.size() - 1;
+    size_t first = out.size();
+    for (int i = 0; i < chunks; i++) {
+        StyleChunk *c = new StyleChunk;
+        c->start = bounds[i];
+        out.push_back(c);
+    }
+
+    // Speculative pass: every chunk but the first assumes plain text at its start
+    std::vector<char> ends(chunks);
+    auto lex = [&](int i) {
+        std::vector<char> scratch;
+        ends[i] = lex_chunk(lang, snap, bounds[i], bounds[i + 1], i == 0 ? state : 'A', *out[first + i], scratch);
+    };
+    if (chunks == 1) lex(0);
+    else ThreadPool::shared().parallel_for(chunks, lex);
+
+    // Stitch: carry the true state across each boundary
+    std::vector<char> scratch;
+    for (int i = 0; i < chunks; i++) {
+        StyleChunk &c = *out[first + i];
+        if (i > 0 && state != 'A') ends[i] = restitch_chunk(lang, snap, c, state, ends[i], scratch);
+        state = ends[i];
+        c.line = line;
+        if (line >= 0) line += (int)c.states.size();
+    }
+    return state;
+}
+
+// Lexes [start, end) of the job's snapshot (extended to whole lines) into chunks
+static bool lex_range(const HighlightJob &job, int start, int end, char state, int line) {
+    const int WORKER_CHUNK = 256 * 1024;
+    ThreadPool &pool = ThreadPool::shared();
+    std::vector<StyleChunk *> batch;
+    if (end > start) end = next_line_start(job.snap, end - 1, job.snap.length()); // Chunks hold whole lines
+    while (start < end) {
+        if (job.generation != highlight_generation.load()) return false;
+        batch.clear();
+        state = lex_batch(*job.lang, job.snap, start, end, line, state, WORKER_CHUNK, pool.size(), batch);
+        for (size_t i = 0; i < batch.size(); i++) {
+            StyleChunk *c = batch[i];
+            c->generation = job.generation;
+            start += (int)c->styles.size() - 1;
+            if (line >= 0) line += (int)c->states.size();
+            if (!publish_chunk(c)) {
+                for (size_t k = i + 1; k < batch.size(); k++) delete batch[k];
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void highlight_worker() {
+    for (;;) {
+        HighlightJob *job;
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_cv.wait(lock, [] { return next_job != nullptr; });
+            job = next_job;
+            next_job = nullptr;
+        }
+        // Visible ranges first, so every view shows colour right away
+        for (size_t i = 0; i + 1 < job->viewports.size(); i += 2) {
+            int first = job->viewports[i] > job->start ? job->viewports[i] : job->start;
+            if (first < job->viewports[i + 1] &&
+                !lex_range(*job, first, job->viewports[i + 1], 'A', -1)) break;
+        }
+        lex_range(*job, job->start, job->snap.length(), job->state, job->line);
+        delete job; // Releases the snapshot on this thread; the node pool is thread safe
+    }
+}
 
-cleanup:
-    free(text); free(style);
-    // --- Redisplay ALL windows ---
+// Cancels in-flight work and queues a job from the current frontier (UI thread)
+static void highlight_restart() {
+    unsigned generation = ++highlight_generation;
+    if (!highlight_pending) return;
+
+    HighlightJob *job = new HighlightJob;
+    job->generation = generation;
+    job->lang = language;
+    job->snap = document.snapshot();
+    job->start = frontier_pos;
+    job->line = frontier_line;
+    job->state = line_states[frontier_line];
     for (EditorWindow* w : windows) {
-        if (w && w->editor) { // Check if window and editor still exist
-             w->editor->redisplay_range(start, end);
+        if (!w || !w->editor) continue;
+        // Right after a load the view may not have laid out yet; assume a screenful
+        int first = w->editor->first_visible(), last = w->editor->last_visible();
+        if (last < first + 16 * 1024) last = first + 16 * 1024;
+        job->viewports.push_back(first);
+        job->viewports.push_back(last < job->snap.length() ? last : job->snap.length());
+    }
+
+    static std::once_flag started;
+    std::call_once(started, [] { std::thread(highlight_worker).detach(); });
+    std::lock_guard<std::mutex> lock(job_mutex);
+    delete next_job; // Superseded before the worker picked it up
+    next_job = job;
+    job_cv.notify_one();
+}
+
+// --- Full Restyle ---
+
+int style_deferred = 0;
+static const int ASYNC_INSERT = 64 * 1024; // Larger inserts are restyled on the worker
+
+static const int PLAIN_BLOCK = 64 * 1024;
+
+// 'n' (at most PLAIN_BLOCK) plain styles, '\0' terminated, from one static block
+static const char *plain_styles(int n) {
+    static char plain[PLAIN_BLOCK + 1];
+    if (!plain[0]) memset(plain, 'A', PLAIN_BLOCK);
+    return plain + (PLAIN_BLOCK - n);
+}
+
+// Resets stylebuf to plain styles for the whole document
+static void style_fill_plain() {
+    stylebuf.text("");
+    for (int left = document.length(); left > 0; ) {
+        int n = left < PLAIN_BLOCK ? left : PLAIN_BLOCK;
+        stylebuf.append(plain_styles(n));
+        left -= n;
+    }
+}
+
+// --- Lazy Highlighting ---
+// A document of style_lazy_min bytes or more is not lexed as a whole. Checkpoints split
+// it into blocks of at most LAZY_BLOCK lines and about LAZY_BLOCK_BYTES (but at least one
+// line), each holding the lexer state at its first line and whether the block's styles
+// are final. Drawing a view styles the blocks around
+// its visible lines (style_visible()) and everything else stays plain until shown. A view
+// far from any checkpoint starts a new one there, assuming plain text (as the worker's
+// viewport pass does), so a jump re-lexes at most one block before what it shows.
+// Checkpoints move with the text on edits; the edited block is re-lexed, and a block whose
+// entry state changes is styled again when it is next shown.
+
+namespace {
+struct Checkpoint {
+    int pos;     // Line start
+    char state;  // Lexer state at 'pos'
+    bool styled; // The block up to the next checkpoint has final styles for 'state'
+};
+}
+
+int style_lazy_min = 64 * 1024 * 1024;
+static const int LAZY_BLOCK = 512;  // Lines per block, and so the most re-lexed to show any line
+static const int LAZY_BLOCK_BYTES = 256 * 1024; // Bytes per block, where lines are long
+static const int LAZY_MARGIN = 64;  // Lines styled above and below the visible ones
+static const int LAZY_MARGIN_BYTES = LAZY_BLOCK_BYTES / 4; // At most this far from them
+static int lazy = 0;
+static std::vector<Checkpoint> &checkpoints = *new std::vector<Checkpoint>;
+
+// Index of the block holding 'pos'
+static size_t lazy_block_of(int pos) {
+    size_t lo = 0, hi = checkpoints.size() - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        if (checkpoints[mid].pos <= pos) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Drops the line state table and background work; everything is unstyled
+static void lazy_start() {
+    lazy = 1;
+    highlight_pending = 0;
+    highlight_restart();
+    std::vector<char>(1, 'A').swap(line_states);
+    checkpoints.assign(1, Checkpoint{ 0, 'A', false });
+}
+
+static void lazy_stop() {
+    lazy = 0;
+    std::vector<Checkpoint>().swap(checkpoints);
+}
+
+// Lexes block 'i' (splitting off what lies beyond LAZY_BLOCK lines or LAZY_BLOCK_BYTES)
+// and hands its end state to the next block, which has to be styled again if that changed it
+static void lazy_style_block(size_t i) {
+    int start = checkpoints[i].pos;
+    int text_len = textbuf.length();
+    int end = i + 1 < checkpoints.size() ? checkpoints[i + 1].pos : text_len;
+    int first_line = line_index.line_of(start);
+    int split_line = first_line + LAZY_BLOCK;
+    if (end - start > LAZY_BLOCK_BYTES) { // Long lines: the last line start within the cap
+        int cap_line = line_index.line_of(start + LAZY_BLOCK_BYTES);
+        if (cap_line <= first_line) cap_line = first_line + 1; // One line longer than the cap
+        if (cap_line < split_line) split_line = cap_line;
+    }
+    if (split_line < line_index.lines() && line_index.line_start(split_line) < end) {
+        end = line_index.line_start(split_line);
+        checkpoints.insert(checkpoints.begin() + i + 1, Checkpoint{ end, 0, false });
+    }
+    char state = checkpoints[i].state;
+    if (end > start) {
+        PieceSnapshot snap = document.snapshot();
+        if ((int)relex_styles.size() < end - start + 1) relex_styles.resize(end - start + 1);
+        char *style = relex_styles.data();
+        relex_gather.clear();
+        for (int pos = start; pos < end; ) {
+            int n;
+            const char *text = next_lines(snap, pos, end - pos, relex_gather, &n);
+            if (n > end - pos) n = end - pos; // Only while the document runs ahead of textbuf
+            state = style_parse(text, style + (pos - start), n, state);
+            pos += n;
+        }
+        style[end - start] = '\0';
+        stylebuf.replace(start, end, style);
+        damage_range(start, end);
+        trim_scratch(relex_styles, end - start + 1);
+        trim_scratch(relex_gather, relex_gather.size());
+    }
+    checkpoints[i].styled = true;
+    if (i + 1 < checkpoints.size()) {
+        Checkpoint &next = checkpoints[i + 1];
+        if (next.state != state) {
+            next.state = state;
+            next.styled = false; // Colours are redone when it is next shown
         }
     }
 }
 
+// Styles the unstyled blocks holding [from, to], plus LAZY_MARGIN lines on either side
+static void lazy_style(int from, int to) {
+    int first = line_index.line_of(from) - LAZY_MARGIN;
+    int last = line_index.line_of(to) + LAZY_MARGIN;
+    if (first < 0) first = 0;
+    if (last >= line_index.lines()) last = line_index.lines() - 1;
+    int start = line_index.line_start(first), end = line_index.line_end(last);
+    if (start < from - LAZY_MARGIN_BYTES) { // Long lines: fewer of them
+        int line = line_index.line_of(from - LAZY_MARGIN_BYTES) + 1;
+        start = line_index.line_start(line < line_index.line_of(from) ? line : line_index.line_of(from));
+    }
+    if (end > to + LAZY_MARGIN_BYTES) end = to + LAZY_MARGIN_BYTES;
+    size_t i = lazy_block_of(start);
+    const Checkpoint &at = checkpoints[i];
+    if (!at.styled && (line_index.line_of(at.pos) + LAZY_BLOCK < first || at.pos + LAZY_BLOCK_BYTES < start)) {
+        // Far from the last checkpoint: start a new one here instead of lexing the gap
+        checkpoints.insert(checkpoints.begin() + i + 1, Checkpoint{ start, 'A', false });
+        i++;
+    }
+    for (; i < checkpoints.size() && checkpoints[i].pos <= end; i++) {
+        if (!checkpoints[i].styled) lazy_style_block(i);
+    }
+}
+
+// Moves the checkpoints with an edit and re-lexes the edited block if it was styled
+static void lazy_update(int pos, int nInserted, int nDeleted) {
+    size_t i = lazy_block_of(pos);
+    bool styled = checkpoints[i].styled;
+    // A checkpoint whose preceding newline was deleted no longer starts a line
+    size_t gone = i + 1;
+    while (gone < checkpoints.size() && checkpoints[gone].pos <= pos + nDeleted) gone++;
+    checkpoints.erase(checkpoints.begin() + i + 1, checkpoints.begin() + gone);
+    for (size_t k = i + 1; k < checkpoints.size(); k++) checkpoints[k].pos += nInserted - nDeleted;
+    checkpoints[i].styled = false;
+    if (styled) lazy_style(pos, pos);
+}
+
+void style_visible(int first, int last) {
+    if (!lazy || style_deferred) return;
+    PerfScope timer(PERF_STYLE_UPDATE);
+    lazy_style(first, last);
+}
+
+// Re-styles the whole document from scratch on the calling thread (with the thread pool)
+// and rebuilds the line state table. Lexes straight out of the document's pieces (e.g. a
+// mapped file) in line-aligned batches, so no full-size copy of the text or of the styles
+// is ever made.
+void style_rebuild() {
+    const int STYLE_CHUNK = 1 << 20;
+    PieceSnapshot snap = document.snapshot();
+    int text_len = snap.length();
+    ThreadPool &pool = ThreadPool::shared();
+    // Enough chunks for every thread, several per thread so uneven ones balance out
+    int chunk_len = text_len / (pool.size() * 4);
+    if (chunk_len > STYLE_CHUNK) chunk_len = STYLE_CHUNK;
+    if (chunk_len < MIN_LEX_CHUNK) chunk_len = MIN_LEX_CHUNK;
+    std::vector<StyleChunk *> batch;
+    char state = 'A';
+
+    highlight_pending = 0;
+    highlight_restart(); // Cancels any background work
+    lazy_stop();
+    line_states.assign(1, 'A');
+    if (language->is_plain()) {
+        style_fill_plain();
+        return;
+    }
+    stylebuf.text("");
+    for (int pos = 0; pos < text_len; ) {
+        batch.clear();
+        state = lex_batch(*language, snap, pos, text_len, 0, state, chunk_len, pool.size() * 4, batch);
+        for (StyleChunk *c : batch) {
+            stylebuf.append(c->styles.data());
+            line_states.insert(line_states.end(), c->states.begin(), c->states.end());
+            pos += (int)c->styles.size() - 1;
+            delete c;
+        }
+    }
+}
+
+// Resets the document to plain styles and colours it on the worker thread, visible
+// ranges first, or lazily as the views show it when it is large. Returns immediately.
+void style_rebuild_async() {
+    style_fill_plain();
+    if (document.length() >= style_lazy_min && !language->is_plain()) {
+        lazy_start();
+        damage_range(0, document.length()); // The views style what they show as they redraw
+        return;
+    }
+    lazy_stop();
+    line_states.assign(1, 'A');
+    frontier_pos = 0;
+    frontier_line = 0;
+    highlight_pending = document.length() > 0 && !language->is_plain();
+    highlight_restart();
+}
+
+void style_set_language(const Language *lang) {
+    if (!lang || lang == language) return;
+    language = lang;
+    style_rebuild_async();
+}
+
+// --- Parked Styles ---
+
+void style_park(ParkedStyles *parked, bool keep) {
+    const int PARK_CHUNK = 1 << 20;
+    keep = keep && !highlight_pending && !lazy && !language->is_plain(); // Plain styles cost nothing to redo
+    highlight_pending = 0;
+    highlight_restart(); // Drops chunks still on their way for this document
+    lazy_stop();
+    parked->styles.clear();
+    parked->line_states.clear();
+    if (!keep) return;
+    int len = stylebuf.length();
+    for (int pos = 0; pos < len; pos += PARK_CHUNK) {
+        int end = pos + PARK_CHUNK < len ? pos + PARK_CHUNK : len;
+        char *styles = stylebuf.text_range(pos, end);
+        parked->styles.append(styles, end - pos);
+        free(styles);
+    }
+    parked->styles.trim();
+    parked->line_states.swap(line_states);
+}
+
+void style_unpark(ParkedStyles *parked) {
+    int len = textbuf.length();
+    if (parked->styles.empty() || parked->styles.length() != len) {
+        style_rebuild_async();
+    } else {
+        std::string styles(len, '\0');
+        parked->styles.expand(0, len, &styles[0]);
+        stylebuf.text(styles.c_str());
+        line_states.swap(parked->line_states);
+        highlight_pending = 0;
+        highlight_restart();
+    }
+    parked->styles.clear();
+    parked->line_states = std::vector<char>(); // Releases the memory, not just the contents
+}
+
+// Updates the style buffer based on changes in the text buffer.
+// Only the edited lines are re-lexed, plus any following lines whose entry state changed.
+void style_update(int pos, int nInserted, int nDeleted, int, const char *deletedText, void* /*cbArg*/) {
+    if (nInserted == 0 && nDeleted == 0) return; // Ignore selection-only changes
+    damage_edit(pos, nInserted, nDeleted); // Keep repaints queued earlier in this event on their text
+    if (style_deferred) return; // A style_rebuild() will follow
+    PerfScope timer(PERF_STYLE_UPDATE);
+
+    // --- Handle buffer modification ---
+    if (nInserted > 0) { // Placeholder styles for the new text, without allocating
+        int n = nInserted < PLAIN_BLOCK ? nInserted : PLAIN_BLOCK;
+        stylebuf.replace(pos, pos + nDeleted, plain_styles(n));
+        for (int at = pos + n; at < pos + nInserted; at += n) {
+            n = pos + nInserted - at < PLAIN_BLOCK ? pos + nInserted - at : PLAIN_BLOCK;
+            stylebuf.insert(at, plain_styles(n));
+        }
+    } else {
+        stylebuf.remove(pos, pos + nDeleted);
+    }
+    if (language->is_plain()) return; // Nothing else to do: every byte is 'A'
+
+    if (!lazy && nInserted > ASYNC_INSERT && document.length() >= style_lazy_min) {
+        lazy_start(); // A file streaming in has grown past the size worth lexing in full
+    }
+    if (lazy) {
+        lazy_update(pos, nInserted, nDeleted);
+        return;
+    }
+
+    int line = line_index.line_of(pos); // Lines before pos are as they were
+    if (highlight_pending && pos + nDeleted >= frontier_pos) {
+        // The edit reaches into the unfinished region: pull the frontier back to the
+        // edited line if needed and let the worker redo everything from there
+        if (pos < frontier_pos) {
+            frontier_pos = line_index.line_start(line);
+            frontier_line = line;
+            line_states.resize(line + 1);
+        }
+        highlight_restart();
+        return;
+    }
+    if (!highlight_pending && nInserted > ASYNC_INSERT) {
+        // Too much new text to lex between two keystrokes (a big paste, a file streaming
+        // in): everything from the edited line on becomes unfinished and the worker
+        // restyles it, keeping the old styles of the text after the insert until then
+        frontier_pos = line_index.line_start(line);
+        frontier_line = line;
+        line_states.resize(line + 1);
+        highlight_pending = 1;
+        highlight_restart();
+        return;
+    }
+
+    // --- Keep the line state table in step with the edit ---
+    int removed_lines = 0;
+    if (deletedText) {
+        for (int i = 0; i < nDeleted; i++) if (deletedText[i] == '\n') removed_lines++;
+    }
+    int added_lines = nInserted > 0 ? line_index.line_of(pos + nInserted) - line : 0;
+    if ((int)line_states.size() < line + 1 + removed_lines) {
+        // Table out of step with the buffer (should not happen); start over
+        style_rebuild();
+        damage_range(0, textbuf.length());
+        return;
+    }
+    line_states.erase(line_states.begin() + line + 1, line_states.begin() + line + 1 + removed_lines);
+    line_states.insert(line_states.begin() + line + 1, added_lines, 0);
+    if (highlight_pending) {
+        frontier_pos += nInserted - nDeleted;
+        frontier_line += added_lines - removed_lines;
+    }
+
+    // --- Re-lex from the edited line until the line states converge ---
+    int start = line_index.line_start(line);
+    int end = style_relex(start, line, pos + nInserted);
+    if (highlight_pending) highlight_restart(); // Positions in the worker's snapshot moved
+
+    // --- Repaint the restyled range in every view that shows it ---
+    damage_range(start, end);
+    timer.bytes(end - start);
+}
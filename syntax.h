@@ -2,20 +2,36 @@
 #define SYNTAX_H
 
 #include <FL/Fl_Text_Display.H> // For Style_Table_Entry
+#include <vector>
+#include "StyleRuns.h"
+
+class Language;
 
 // --- Syntax Highlighting Data (Declarations) ---
 // Defined in syntax.cpp
 extern Fl_Text_Display::Style_Table_Entry styletable[];
 extern int styletable_size; // Declaration for the table size (removed const)
-extern const char *code_keywords[];
-extern const int num_keywords;
-extern const char *code_types[];
-extern const int num_types;
 
 // --- Syntax Highlighting Function Declarations ---
-void style_parse(const char *text, char *style, int length);
+// Styles 'length' bytes of whole lines with the rules of 'lang' (the document's language if nullptr)
+char style_parse(const char *text, char *style, int length, char state = 'A', const Language *lang = nullptr);
+void style_rebuild(); // Re-styles the whole document and resets the line state table
+void style_rebuild_async(); // Same, but on a worker thread with progressive repaint
+void style_set_language(const Language *lang); // Switches the document to 'lang' (if not nullptr) and restyles
+// Styles of a document while another one is in textbuf (see workspace.h)
+struct ParkedStyles {
+    StyleRuns styles;              // Empty when they were dropped: the document is restyled when shown
+    std::vector<char> line_states;
+};
+// Stops highlighting the document in textbuf and, if 'keep' and its styles are final, moves
+// them into 'parked'
+void style_park(ParkedStyles *parked, bool keep);
+void style_unpark(ParkedStyles *parked); // Puts parked styles back, or restyles in the background
+extern int style_deferred; // While set, style_update() skips work; call style_rebuild() after
+extern int style_lazy_min; // Documents from this size on are only styled around what the views show
+extern int style_scalar; // While set, style_parse() skips runs a byte at a time rather than with SIMD
+void style_visible(int first, int last); // Styles what a view shows of [first, last) if not yet done
 void style_update(int pos, int nInserted, int nDeleted, int nRestyled, const char *deletedText, void *cbArg);
-int compare_keywords(const void *p1, const void *p2); // Used by bsearch
 
 #endif // SYNTAX_H
 
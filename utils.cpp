@@ -2,115 +2,146 @@
 #include "globals.h"      // Access global vars (filename, changed, textbuf, stylebuf, windows)
 #include "EditorWindow.h" // Need full definition for set_title, new_view
 #include "callbacks.h"    // For check_save calling save_cb
-#include "syntax.h"       // For load_file calling style_parse
+#include "loader.h"       // For the load progress in titles
+#include "saver.h"        // For check_save waiting on the save
+#include "SearchPattern.h" // For replace_all
+#include "Regex.h"         // For regex replace_all
+#include "Perf.h"          // Timers on replace all
+#include "syntax.h"        // For restyling once after a recovery
+#include "workspace.h"     // For the document name in titles
 
 #include <FL/fl_ask.H>
-#include <FL/Fl_File_Chooser.H> // For fl_file_chooser used by load_file
 #include <string>
 #include <vector>
-#include <cstdio>  // For strerror
+#include <cstdio>  // For snprintf
 #include <cstring> // For strcpy, strrchr, strlen, memset
 #include <cstdlib> // For free
+#include <memory>
 
 // --- Utility Function Implementations ---
 
-// Sets the window title based on filename and changed status
+// Sets the window title based on filename and changed status, and the document tabs.
+// Runs after every keystroke, so the title is composed on the stack and compared first.
 void set_title(EditorWindow* w) {
     if (!w) return;
-    std::string title_str;
-    if (filename[0] == '\0') {
-        title_str = "Untitled";
-    } else {
-        const char* slash = strrchr(filename, '/');
-        #ifdef _WIN32 // Handle Windows backslashes too
-        const char* backslash = strrchr(filename, '\\');
-        if (backslash > slash) slash = backslash;
-        #endif
-        title_str = (slash ? slash + 1 : filename); // Use part after last slash, or whole string
-    }
-    if (changed) {
-        title_str += " *"; // Use asterisk for modified indicator
+    w->update_tabs();
+    char title[sizeof(filename) + 64];
+    document_label(document_active(), title, sizeof(title)); // File name and modified indicator
+    size_t len = strlen(title);
+    if (save_busy()) len += snprintf(title + len, sizeof(title) - len, " (saving)");
+    if (load_busy()) {
+        int progress = load_progress();
+        if (progress >= 0) len += snprintf(title + len, sizeof(title) - len, " (loading %d%%)", progress);
+        else len += snprintf(title + len, sizeof(title) - len, " (loading)");
     }
     // Add view number if more than one view exists
     if (windows.size() > 1 && w->window_number > 0) { // Check window_number validity
-         title_str += " - View " + std::to_string(w->window_number);
+        snprintf(title + len, sizeof(title) - len, " - View %d", w->window_number);
     }
-    w->copy_label(title_str.c_str()); // Set the window's label
+    if (w->title == title) return; // Relabelling makes the window manager redraw the frame
+    w->title = title;
+    w->copy_label(title); // Set the window's label
 }
 
 // Checks if the buffer is changed and asks the user to save if it is.
 // Returns: 1 if it's safe to proceed (not changed, saved, or discarded), 0 if user cancelled.
 int check_save() {
+    save_wait(); // A save still being written decides whether anything is unsaved
     if (!changed) return 1; // Not changed, safe to proceed
 
-    int r = fl_choice("Save changes to document?", // Prompt
+    int r = fl_choice("Save changes to \'%s\'?",    // Prompt (several documents may be open)
                       "Cancel",                    // Button 0
                       "Save",                      // Button 1
-                      "Don't Save");               // Button 2
+                      "Don't Save",                // Button 2
+                      filename[0] ? filename : "Untitled");
 
     if (r == 1) { // Save chosen
         save_cb(nullptr, nullptr); // Call the global save callback
+        save_wait();
         return !changed; // Return 1 if save succeeded (changed==0), 0 otherwise
     }
 
     return (r != 0); // Return 1 if Don't Save (r=2), 0 if Cancel (r=0)
 }
 
-// Loads/inserts a file into the global text buffer and updates styles
-void load_file(const char *newfile, int ipos) {
-    loading = 1; // Prevent changed_cb from setting 'changed' flag during load
-    int insert = (ipos != -1); // Check if inserting or replacing buffer content
-    if (!insert) {
-        strncpy(filename, newfile, sizeof(filename) - 1); // Update global filename only when replacing
-        filename[sizeof(filename) - 1] = '\0';
-    }
+// Replaces every occurrence of 'find' with 'replace' in one pass over the document.
+// The result for the span between the first and last match is built in a single buffer
+// and committed as one textbuf.replace(), so the modify callbacks, the restyle and the
+// undo record happen once. Returns the number of replacements, or -1 (changing nothing)
+// if the result would hold a NUL byte: textbuf takes C strings and would cut it short there.
+int replace_all(const char *find, const char *replace, int flags) {
+    SearchPattern pattern(find, flags);
+    if (pattern.length() == 0) return 0;
 
-    int r; // Result of file operation
-    if (!insert) {
-        r = textbuf.loadfile(newfile); // Replace buffer content
-    } else {
-        r = textbuf.insertfile(newfile, ipos); // Insert file content at position
+    PieceSnapshot snap = document.snapshot();
+    PerfScope timer(PERF_REPLACE_ALL, snap.length());
+    std::string out;
+    int first = -1;  // Start of the first match
+    int copied = 0;  // Document position up to which 'out' is complete
+    int times = 0;
+    for (int pos = pattern.find(snap, 0); pos >= 0; pos = pattern.find(snap, copied)) {
+        if (first < 0) first = copied = pos;
+        size_t o = out.size();
+        out.resize(o + (pos - copied));
+        snap.copy(copied, pos, &out[o]);
+        out += replace;
+        copied = pos + pattern.length(); // Matches do not overlap
+        times++;
     }
 
-    if (r) { // Error occurred
-        fl_alert("Error reading from file \'%s\':\n%s.", newfile, strerror(errno));
-        loading = 0; // Reset loading flag
-        return;      // Exit function on error
-    }
-    // File operation successful
-    changed = insert; // Mark as changed only if inserting, otherwise it's newly loaded/unchanged
-    loading = 0; // Clear loading flag
+    if (out.find('\0') != std::string::npos) return -1;
+    if (times > 0) textbuf.replace(first, copied, out.c_str());
+    return times;
+}
 
-    // --- Fully restyle the buffer after load/insert ---
-    int text_len_val = textbuf.length();
-    stylebuf.select(0, stylebuf.length());
-    stylebuf.remove_selection(); // Clear old styles
-    char* text = textbuf.text(); // Get the full text
-    if (text) {
-        char* styles = new char[text_len_val + 1]; // Allocate buffer for styles
-        memset(styles, 'A', text_len_val);         // Initialize with default style 'A'
-        styles[text_len_val] = '\0';
-        style_parse(text, styles, text_len_val);   // Parse text to generate styles
-        stylebuf.text(styles);                     // Set the new styles in the style buffer
-        free(text);                                // Free text buffer allocated by textbuf.text()
-        delete[] styles;                           // Free our allocated style buffer
-    } else {
-        stylebuf.text(""); // Ensure style buffer is empty if text buffer is empty
+// Regex flavour of replace_all: each replacement is expanded from its match's groups.
+// After an empty match one byte is copied through, so the scan always advances.
+int replace_all(const Regex &regex, const char *replace) {
+    PieceSnapshot snap = document.snapshot();
+    PerfScope timer(PERF_REPLACE_ALL, snap.length());
+    std::string out;
+    int first = -1, copied = 0, times = 0;
+    RegexMatch m;
+    for (int from = 0; from <= snap.length() && regex.find(snap, from, &m); ) {
+        if (first < 0) first = copied = m.start;
+        size_t o = out.size();
+        out.resize(o + (m.start - copied));
+        snap.copy(copied, m.start, &out[o]);
+        out += Regex::expand(replace, m, snap);
+        copied = m.end;
+        from = m.end;
+        if (m.end == m.start) {
+            if (m.end < snap.length()) out += snap.byte_at(m.end);
+            copied = from = m.end + 1;
+        }
+        times++;
     }
 
-    textbuf.call_modify_callbacks(); // Update titles and trigger style_update if needed
+    if (out.find('\0') != std::string::npos) return -1; // A group took in a NUL from the document
+    if (times > 0) textbuf.replace(first, copied < snap.length() ? copied : snap.length(), out.c_str());
+    return times;
 }
 
-// Saves the global text buffer to the specified file
-void save_file(const char *newfile) {
-    if (textbuf.savefile(newfile)) { // Attempt to save
-        fl_alert("Error writing to file \'%s\':\n%s.", newfile, strerror(errno));
-    } else { // Success
-        strncpy(filename, newfile, sizeof(filename) - 1); // Update global filename
-        filename[sizeof(filename) - 1] = '\0';
-        changed = 0; // Mark as unchanged
+// Called once the document of 'filename' is in. If a session that did not end cleanly
+// left a journal of unsaved edits to it, offers to replay them (restyled once at the
+// end, undoable in one step); otherwise the document gets a fresh journal.
+void recover_or_start_journal() {
+    if (crash_journal.found(filename)) {
+        int r = fl_choice("Unsaved changes to \'%s\' were left by a session that did not end cleanly.\n"
+                          "Restore them?",
+                          "Discard", "Restore", nullptr, filename[0] ? filename : "Untitled");
+        if (r == 1) {
+            style_deferred = 1;
+            journal.begin_group();
+            int applied = crash_journal.replay(filename, textbuf);
+            journal.end_group();
+            style_deferred = 0;
+            style_rebuild_async();
+            if (applied >= 0) return; // Journalling carries on in the same file
+            fl_alert("The unsaved changes to \'%s\' could not be restored.", filename[0] ? filename : "Untitled");
+        }
     }
-    textbuf.call_modify_callbacks(); // Update titles in all windows
+    crash_journal.start(filename);
 }
 
 // Creates and configures a new EditorWindow instance
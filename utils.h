@@ -4,13 +4,15 @@
 // Forward declare EditorWindow to avoid circular includes if possible
 // If function implementations need full definition, include EditorWindow.h in utils.cpp
 class EditorWindow;
+class Regex;
 
 // --- Utility Function Declarations ---
 void set_title(EditorWindow* w);
 int check_save(); // Checks global 'changed' flag
-void load_file(const char *newfile, int ipos = -1); // Operates on global buffers
-void save_file(const char *newfile); // Operates on global buffers
+int replace_all(const char *find, const char *replace, int flags = 0); // One buffer mutation; returns the count (-1: NUL in result)
+int replace_all(const Regex &regex, const char *replace); // Same, with \0..\9 substitution
 EditorWindow* new_view(); // Creates a new EditorWindow instance
+void recover_or_start_journal(); // Offers a crash journal of 'filename', else starts a fresh one
 
 #endif // UTILS_H
 
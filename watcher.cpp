@@ -0,0 +1,442 @@
+#include "watcher.h"
+#include "globals.h"   // For textbuf, document, journal, crash_journal, filename, changed, swapping, windows
+#include "callbacks.h" // For document_detach
+
+#include <utility> // For std::swap
+
+static FileStamp known; // The version of the file the document holds
+
+void watch_swap(FileStamp &parked) {
+    std::swap(known, parked);
+}
+
+#ifndef _WIN32
+
+#include <cstdlib> // For free, realpath
+#include <string>
+#include <sys/stat.h>
+
+// --- File Stamps ---
+// Kept wherever files are mapped: a file rewritten in place changes the mapped text the
+// document is made of, so the stamp tells when the document must stop reading it.
+
+static std::string path; // The file itself (symlinks resolved)
+
+static bool stamp_of(const char *name, FileStamp *s) {
+    struct stat st;
+    if (stat(name, &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    s->size = st.st_size;
+#ifdef __APPLE__
+    s->mtime = (long long)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    s->mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    s->inode = (long long)st.st_ino;
+    return true;
+}
+
+static bool same(const FileStamp &a, const FileStamp &b) {
+    return a.size == b.size && a.mtime == b.mtime && a.inode == b.inode;
+}
+
+static void resolve_path() {
+    path = filename;
+    if (filename[0] == '\0') return;
+    if (char *real = realpath(filename, nullptr)) {
+        path = real;
+        free(real);
+    }
+}
+
+void watch_detach_if_rewritten() {
+    FileStamp now;
+    if (filename[0] == '\0' || known.size < 0 || !stamp_of(path.c_str(), &now)) return;
+    if (now.inode == known.inode && !same(now, known)) document_detach();
+}
+
+#endif
+
+#ifdef __linux__
+
+#include "loader.h"     // For load_busy, and load_file to reload a file that cannot be mapped
+#include "saver.h"      // For save_busy
+#include "MappedFile.h" // New text is read from a mapping of the file
+
+#include <FL/Fl.H>
+#include <FL/fl_ask.H>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>  // For memchr, memcmp, memcpy
+#include <memory>
+#include <vector>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+static const double CHECK_DELAY = 0.2;  // Seconds a burst of writes gets to settle before a check
+static const double BUSY_DELAY = 0.25;  // Retry interval while a load, save or prompt is running
+static const int TAIL_MATCH = 4096;     // Bytes before the old end that must still be the document's
+static const int TAIL_COPY_MAX = 1 << 20; // Larger tails are mapped rather than copied
+static const int READ_BLOCK = 1 << 20;  // Bytes of textbuf hashed per copy
+static const size_t EDITS_MAX = 256;    // More differences than this are replaced as one range
+
+// --- Watch ---
+// One inotify watch on the directory of the active document's file. Watching the
+// directory rather than the file also sees the file replaced by a rename, which is how
+// most programs (this one included) save it.
+
+static int notify_fd = -1;
+static int watch_fd = -1;     // Watch descriptor of the directory, or -1
+static std::string watched;   // Name of the file in that directory
+static bool checking = false; // A check, and perhaps its prompt, is running
+
+static void check_cb(void *);
+
+static void schedule(double delay) {
+    if (!Fl::has_timeout(check_cb)) Fl::add_timeout(delay, check_cb);
+}
+
+static void notify_cb(int fd, void *) {
+    alignas(inotify_event) char buf[16 * 1024];
+    bool hit = false;
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) { // Non-blocking: drains what is queued
+        for (char *p = buf; p < buf + n; ) {
+            const inotify_event *e = (const inotify_event *)p;
+            if (e->wd == watch_fd && e->len && watched == e->name) hit = true;
+            if (e->mask & IN_Q_OVERFLOW) hit = true; // Events were dropped; one of them may be ours
+            if (e->wd == watch_fd && (e->mask & IN_IGNORED)) watch_fd = -1; // The directory is gone
+            p += sizeof(inotify_event) + e->len;
+        }
+    }
+    if (hit) schedule(CHECK_DELAY);
+}
+
+// Points the watch at the directory of 'filename' (at nothing when untitled)
+static void rewatch() {
+    if (notify_fd < 0) {
+        notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notify_fd < 0) return; // Out of inotify instances: the file simply goes unwatched
+        Fl::add_fd(notify_fd, FL_READ, notify_cb);
+    }
+    if (watch_fd >= 0) inotify_rm_watch(notify_fd, watch_fd);
+    watch_fd = -1;
+    watched.clear();
+    resolve_path();
+    if (filename[0] == '\0') return;
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : path.substr(0, slash ? slash : 1);
+    watched = slash == std::string::npos ? path : path.substr(slash + 1);
+    watch_fd = inotify_add_watch(notify_fd, dir.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+}
+
+// --- Block Hashes ---
+// A reload compares the document with the new file in blocks of whole lines. A block
+// ends after a line whose hash has its low bits clear (about every 32 lines), so the
+// boundaries depend only on the text near them: after an insertion or deletion the
+// blocks of both texts line up again at the next such line.
+
+namespace {
+struct Block {
+    uint64_t hash;
+    int len;
+    bool operator==(const Block &o) const { return hash == o.hash && len == o.len; }
+};
+
+class Blocker {
+public:
+    explicit Blocker(std::vector<Block> &out) : out_(out) {}
+
+    void feed(const char *p, size_t n) {
+        while (n > 0) {
+            const char *nl = (const char *)memchr(p, '\n', n);
+            if (!nl) { line_.append(p, n); return; } // Continues in the next feed
+            size_t take = nl - p + 1;
+            if (line_.empty()) {
+                add_line(p, take);
+            } else {
+                line_.append(p, take);
+                add_line(line_.data(), line_.size());
+                line_.clear();
+            }
+            p += take;
+            n -= take;
+        }
+    }
+
+    void finish() {
+        if (!line_.empty()) add_line(line_.data(), line_.size());
+        line_.clear();
+        if (len_ > 0) end_block();
+    }
+
+private:
+    static const uint64_t MUL = 0xff51afd7ed558ccdULL;
+    static const uint64_t END_MASK = 31;    // Lines per block, on average, minus one
+    static const size_t BLOCK_MAX = 1 << 20; // Blocks of very long lines end sooner
+
+    static uint64_t hash_bytes(const char *p, size_t n) {
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ n;
+        for (; n >= 8; p += 8, n -= 8) {
+            uint64_t w;
+            memcpy(&w, p, 8);
+            h = (h ^ w) * MUL;
+            h ^= h >> 32;
+        }
+        uint64_t w = 0;
+        memcpy(&w, p, n);
+        h = (h ^ w) * MUL;
+        return h ^ (h >> 29);
+    }
+
+    void add_line(const char *p, size_t n) {
+        uint64_t h = hash_bytes(p, n);
+        hash_ = (hash_ ^ h) * MUL;
+        len_ += n;
+        if ((h & END_MASK) == 0 || len_ >= BLOCK_MAX) end_block();
+    }
+
+    void end_block() {
+        out_.push_back({hash_ ^ len_, (int)len_});
+        hash_ = 0;
+        len_ = 0;
+    }
+
+    std::vector<Block> &out_;
+    std::string line_; // Start of a line split between feeds
+    uint64_t hash_ = 0;
+    size_t len_ = 0;
+};
+
+// Replace [from, to) of the document with [new_from, new_to) of the file
+struct Edit {
+    int from, to, new_from, new_to;
+};
+}
+
+static void blocks_of_buffer(std::vector<Block> &out) {
+    Blocker b(out);
+    int len = textbuf.length();
+    for (int pos = 0; pos < len; pos += READ_BLOCK) {
+        int end = len - pos < READ_BLOCK ? len : pos + READ_BLOCK;
+        char *text = textbuf.text_range(pos, end);
+        b.feed(text, end - pos);
+        free(text);
+    }
+    b.finish();
+}
+
+// The edits turning the text of blocks 'a' into that of blocks 'b'. Past the common
+// start and end, each block of 'b' found among the blocks of 'a' not yet passed is kept,
+// and what lies between kept blocks is replaced.
+static std::vector<Edit> diff(const std::vector<Block> &a, const std::vector<Block> &b) {
+    size_t na = a.size(), nb = b.size(), head = 0, tail = 0;
+    while (head < na && head < nb && a[head] == b[head]) head++;
+    while (tail < na - head && tail < nb - head && a[na - 1 - tail] == b[nb - 1 - tail]) tail++;
+
+    std::vector<int> at(na - tail - head + 1); // Document offset of each middle block of 'a'
+    int pos = 0;
+    for (size_t i = 0; i < head; i++) pos += a[i].len;
+    at[0] = pos;
+    for (size_t i = head; i < na - tail; i++) at[i - head + 1] = at[i - head] + a[i].len;
+
+    std::vector<std::pair<uint64_t, size_t>> index; // Middle blocks of 'a' by hash, then position
+    for (size_t i = head; i < na - tail; i++) index.push_back({a[i].hash, i});
+    std::sort(index.begin(), index.end());
+
+    std::vector<Edit> edits;
+    size_t i = head;      // Next block of 'a' that can be kept
+    int new_pos = pos;    // File offset of block j
+    int new_from = pos;   // Start of the file text not yet placed
+    for (size_t j = head; j < nb - tail; j++) {
+        auto it = std::lower_bound(index.begin(), index.end(), std::make_pair(b[j].hash, i));
+        if (it != index.end() && it->first == b[j].hash && a[it->second] == b[j]) {
+            size_t k = it->second;
+            if (k > i || new_pos > new_from) edits.push_back({at[i - head], at[k - head], new_from, new_pos});
+            i = k + 1;
+            new_from = new_pos + b[j].len;
+        }
+        new_pos += b[j].len;
+    }
+    if (i < na - tail || new_pos > new_from) edits.push_back({at[i - head], at[na - tail - head], new_from, new_pos});
+    if (edits.size() > EDITS_MAX) edits = {{edits.front().from, edits.back().to, edits.front().new_from, edits.back().new_to}};
+    return edits;
+}
+
+// --- Reacting ---
+
+// Appends what was written past the end of the known version, if the file is that version
+// with more after it (false otherwise). Nothing of it is an edit: it is not undoable, does
+// not mark the document changed, and restarts the crash journal on the longer file.
+static bool append_tail(const FileStamp &now) {
+    int old_len = textbuf.length();
+    if (changed || now.inode != known.inode || now.size <= known.size || known.size != old_len ||
+        now.size >= INT_MAX) {
+        return false;
+    }
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    int k = old_len < TAIL_MATCH ? old_len : TAIL_MATCH;
+    char disk[TAIL_MATCH];
+    bool kept = pread(fd, disk, k, old_len - k) == k;
+    if (kept && k > 0) {
+        char *mine = textbuf.text_range(old_len - k, old_len);
+        kept = memcmp(mine, disk, k) == 0;
+        free(mine);
+    }
+    if (!kept) {
+        close(fd);
+        return false;
+    }
+
+    int len = (int)(now.size - old_len);
+    std::shared_ptr<MappedFile> map;
+    std::string copy;
+    if (len > TAIL_COPY_MAX) map = MappedFile::open(path.c_str());
+    if (map && map->size > old_len) {
+        len = map->size - old_len;
+    } else {
+        map = nullptr;
+        copy.resize(len);
+        ssize_t got = pread(fd, &copy[0], len, old_len);
+        copy.resize(got > 0 ? (size_t)got : 0);
+        len = (int)copy.size();
+    }
+    close(fd);
+    const char *text = map ? map->data + old_len : copy.c_str(); // Both end in a '\0'
+
+    std::vector<EditorWindow*> following; // Views at the old end move on to the new one
+    for (EditorWindow* w : windows) {
+        if (w && w->editor && w->editor->insert_position() == old_len) following.push_back(w);
+    }
+    // As the loader does: the document takes the text first, then textbuf without mirroring
+    if (map) document.insert(old_len, map, old_len, len);
+    else document.insert(old_len, text, len);
+    swapping = 1;
+    textbuf.insert(old_len, text);
+    swapping = 0;
+    int got = textbuf.length() - old_len;
+    if (got < len) document.remove(old_len + got, len - got); // FLTK stopped at an embedded NUL
+    for (EditorWindow* w : following) {
+        w->editor->insert_position(textbuf.length());
+        w->editor->show_insert_position();
+    }
+
+    stamp_of(path.c_str(), &known);
+    if (known.size != old_len + len) { // Written to again meanwhile: the rest comes next
+        known.size = old_len + len;
+        schedule(CHECK_DELAY);
+    }
+    crash_journal.start(filename);
+    return true;
+}
+
+// Makes the document the file as it is now, editing only the parts that differ, as one
+// undoable step
+static void reload() {
+    FileStamp stamp;
+    stamp_of(path.c_str(), &stamp);
+    std::shared_ptr<MappedFile> map = MappedFile::open(path.c_str());
+    if (!map) { // A file that cannot be mapped is read again as a whole
+        std::string name = filename;
+        load_file(name.c_str());
+        return;
+    }
+    std::vector<Block> mine, theirs;
+    blocks_of_buffer(mine);
+    {
+        Blocker b(theirs);
+        b.feed(map->data, map->size);
+        b.finish();
+    }
+    std::vector<Edit> edits = diff(mine, theirs);
+
+    std::string text;
+    journal.begin_group();
+    for (auto e = edits.rbegin(); e != edits.rend(); ++e) { // From the end: earlier offsets stay put
+        if (e->new_from == e->new_to) {
+            textbuf.remove(e->from, e->to);
+        } else {
+            text.assign(map->data + e->new_from, map->data + e->new_to);
+            textbuf.replace(e->from, e->to, text.c_str());
+        }
+    }
+    journal.end_group();
+
+    changed = 0;
+    known = stamp;
+    crash_journal.start(filename);
+    textbuf.call_modify_callbacks(); // Update titles
+}
+
+static void ask_reload(const FileStamp &now) {
+    known = now; // Asked once for each version
+    int r = fl_choice("\'%s\' was changed by another program.\nReload it%s?",
+                      "Keep", "Reload", nullptr, filename, changed ? " and lose your changes" : "");
+    if (r == 1) reload();
+}
+
+static void check_cb(void *) {
+    if (filename[0] == '\0') return;
+    if (checking || load_busy() || save_busy()) { // Their own completion restamps the file
+        schedule(BUSY_DELAY);
+        return;
+    }
+    FileStamp now;
+    if (known.size < 0) { // Nothing known (it did not exist): this is the version from now on
+        stamp_of(path.c_str(), &known);
+        return;
+    }
+    if (!stamp_of(path.c_str(), &now) || same(now, known)) return; // Gone (or being replaced), or ours
+    checking = true;
+    if (!append_tail(now)) {
+        // Rewritten in place: the document's mapped text is changing under it. It takes a
+        // copy of textbuf's before the prompt, so that keeping the text keeps all of it.
+        if (now.inode == known.inode) document_detach();
+        ask_reload(now);
+    }
+    checking = false;
+}
+
+// --- Entry Points ---
+
+void watch_file(long long size) {
+    rewatch();
+    known = FileStamp();
+    if (filename[0] == '\0' || !stamp_of(path.c_str(), &known)) return;
+    if (size >= 0 && size != known.size) { // Changed while loading
+        known.size = size;
+        schedule(CHECK_DELAY);
+    }
+}
+
+void watch_check() {
+    rewatch();
+    if (filename[0] != '\0') schedule(0.0);
+}
+
+#else // No inotify: other programs' changes go unnoticed until the document is saved
+
+void watch_file(long long size) {
+    known = FileStamp();
+#ifndef _WIN32
+    resolve_path();
+    if (filename[0] != '\0' && stamp_of(path.c_str(), &known) && size >= 0) known.size = size;
+#else
+    (void)size;
+#endif
+}
+
+void watch_check() {
+#ifndef _WIN32
+    resolve_path();
+    watch_detach_if_rewritten();
+#endif
+}
+
+#endif
+
+#ifdef _WIN32
+void watch_detach_if_rewritten() {} // Files are read, not mapped
+#endif
@@ -0,0 +1,26 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+// --- External Change Watching (Declarations) ---
+// The active document's file is watched (inotify, on Linux) for changes made by other
+// programs. When it has only grown and the text it had is untouched, as with a log being
+// written, just the new tail is read and appended, and views whose cursor was at the end
+// follow it. Any other change asks before reloading, and a reload edits only the parts
+// that differ: both texts are cut into line-aligned blocks that resynchronise after an
+// insertion, and the blocks found in both are kept.
+struct FileStamp {
+    long long size = -1; // -1: no known version of the file
+    long long mtime = 0;
+    long long inode = 0;
+};
+
+// Watches 'filename', taking the file as it is on disk now as the document's version.
+// With 'size' >= 0, only its first 'size' bytes are in the document (it grew while loading).
+void watch_file(long long size = -1);
+void watch_swap(FileStamp &parked); // Exchanges the known version with a parked document's
+void watch_check(); // Watches 'filename' again after a switch and deals with changes made since
+// Copies the document off the file's mapping if the file was rewritten in place since the
+// known version (cut short or changed under the mapped text)
+void watch_detach_if_rewritten();
+
+#endif // WATCHER_H
@@ -0,0 +1,270 @@
+#include "workspace.h"
+#include "globals.h"   // The active document: textbuf, document, journal, crash_journal, filename, ...
+#include "syntax.h"    // For style_park, style_unpark, style_rebuild
+#include "loader.h"    // A document cannot be left while it loads
+#include "saver.h"     // For save_wait
+#include "utils.h"     // For check_save
+#include "redisplay.h" // For damage_titles (the tabs show the documents)
+#include "watcher.h"   // Only the active document's file is watched
+
+#include <FL/fl_ask.H>
+#include <utility>
+#include <vector>
+#include <cstdio>  // For snprintf
+#include <cstring> // For memcpy, strcmp, strrchr
+
+// --- Documents ---
+
+namespace {
+struct Document {
+    PieceTable pieces;
+    UndoJournal undo;
+    CrashJournal crash;
+    const Language *lang = &Language::cpp();
+    char name[sizeof(filename)] = "";
+    int changed = 0;
+    int cursor = 0;      // Insert position of the views when it was parked
+    ParkedStyles styles;
+    FileStamp stamp;     // Version of its file it holds, checked when it is shown again
+};
+}
+
+static const int PARK_STYLES_MAX = 64 * 1024 * 1024; // Larger documents drop their styles when parked
+
+// The active document's slot is empty: its contents are in the globals
+static std::vector<Document *> docs;
+static std::vector<Document *> spare; // Closed slots, reused with their journal writer threads
+static int active = 0;
+
+static std::vector<Document *> &slots() {
+    if (docs.empty()) docs.push_back(new Document);
+    return docs;
+}
+
+// Exchanges the contents of the globals and 'd'
+static void exchange(Document &d) {
+    document.swap(d.pieces);
+    std::swap(journal, d.undo);
+    crash_journal.swap(d.crash);
+    std::swap(language, d.lang);
+    char name[sizeof(filename)];
+    memcpy(name, filename, sizeof(name));
+    memcpy(filename, d.name, sizeof(filename));
+    memcpy(d.name, name, sizeof(name));
+    std::swap(changed, d.changed);
+    watch_swap(d.stamp);
+}
+
+static const int FILL_CHUNK = 1024 * 1024; // Bytes handed to textbuf at a time
+
+// Gives the empty textbuf the document's text, read out of the pieces a chunk at a time.
+// The gap is made room for all of it first, so the buffer is allocated once and the
+// appends only copy. Like a load, it stops at an embedded NUL (a file rewritten in place
+// under the mapping can leave zeros), and the document is cut to match.
+static void fill_textbuf() {
+    int len = document.length();
+    textbuf.reserve(0, len);
+
+    static std::vector<char> &chunk = *new std::vector<char>; // '\0' terminated for append()
+    chunk.reserve(FILL_CHUNK + 1);
+    bool whole = true;
+    auto flush = [&] {
+        int before = textbuf.length();
+        chunk.push_back('\0');
+        textbuf.append(chunk.data());
+        whole = textbuf.length() - before == (int)chunk.size() - 1;
+        chunk.clear();
+    };
+    document.for_each_chunk(0, len, [&](const char *p, int n) {
+        while (n > 0 && whole) {
+            int take = n < FILL_CHUNK - (int)chunk.size() ? n : FILL_CHUNK - (int)chunk.size();
+            chunk.insert(chunk.end(), p, p + take);
+            p += take;
+            n -= take;
+            if ((int)chunk.size() == FILL_CHUNK) flush();
+        }
+    });
+    if (!chunk.empty() && whole) flush();
+    if (textbuf.length() < len) {
+        document.remove(textbuf.length(), len - textbuf.length());
+        journal.clear(); // Its records reach into the text that was cut
+    }
+}
+
+// Parks the active document and puts docs[index] in its place. textbuf gets the new
+// text straight from the pieces; the line index follows it as usual, while the other
+// modify callbacks skip it (it is not an edit) and the styles are restored or rebuilt
+// afterwards. A parked document stays on its file's mapping; watch_check() copies it off
+// if the file was rewritten in place meanwhile.
+static void activate(int index, bool keep_styles) {
+    Document &from = *docs[active], &to = *docs[index];
+    from.cursor = !windows.empty() && windows[0]->editor ? windows[0]->editor->insert_position() : 0;
+    style_park(&from.styles, keep_styles && document.length() <= PARK_STYLES_MAX);
+
+    swapping = 1;
+    style_deferred = 1;
+    textbuf.text("");
+    exchange(from);
+    exchange(to);
+    active = index;
+    fill_textbuf();
+    swapping = 0;
+    style_deferred = 0;
+    style_unpark(&to.styles);
+
+    int cursor = to.cursor < textbuf.length() ? to.cursor : textbuf.length();
+    for (EditorWindow* w : windows) {
+        if (!w || !w->editor) continue;
+        w->editor->insert_position(cursor);
+        w->editor->show_insert_line();
+        w->findall_results.clear(); // Positions in the other document
+        w->findall_list->clear();
+        w->findall_dlg->hide();
+    }
+    textbuf.call_modify_callbacks(); // Titles, tabs and line:column displays
+    watch_check();
+}
+
+// Empties the active document, which becomes untitled
+static void clear_active() {
+    document.clear(); // First: the restyle of the emptied textbuf reads the document
+    swapping = 1;
+    textbuf.text("");
+    swapping = 0;
+    journal.clear(); // A new document starts with no history
+    filename[0] = '\0';
+    changed = 0;
+    watch_file(); // Nothing to watch
+    language = &Language::cpp(); // The default until it is saved under a name that says otherwise
+    style_rebuild(); // Resets the line state table for the empty document
+    crash_journal.start(""); // Nor anything to recover
+    textbuf.call_modify_callbacks(); // Update all views
+}
+
+// Puts a closed document's slot aside for the next document_new()
+static void recycle(Document *d) {
+    d->pieces.clear();
+    d->undo.clear();
+    d->crash.stop();
+    d->lang = &Language::cpp();
+    d->name[0] = '\0';
+    d->changed = 0;
+    d->cursor = 0;
+    d->styles = ParkedStyles();
+    d->stamp = FileStamp();
+    spare.push_back(d);
+}
+
+// False (after telling the user) if the active document cannot be parked yet
+static bool can_leave() {
+    if (load_busy()) {
+        fl_alert("\'%s\' is still loading.\nWait for it to finish, or press Escape to stop it.", filename);
+        return false;
+    }
+    save_wait(); // The save's result belongs to the document it was started on
+    return true;
+}
+
+// --- Queries ---
+
+int document_count() {
+    return (int)slots().size();
+}
+
+int document_active() {
+    return active;
+}
+
+void document_label(int index, char *out, size_t size) {
+    const Document &d = *slots()[index];
+    const char *name = index == active ? filename : d.name;
+    if (name[0] == '\0') {
+        name = "Untitled";
+    } else {
+        const char* slash = strrchr(name, '/');
+        #ifdef _WIN32 // Handle Windows backslashes too
+        const char* backslash = strrchr(name, '\\');
+        if (backslash > slash) slash = backslash;
+        #endif
+        if (slash) name = slash + 1; // Use part after last slash, or whole string
+    }
+    // Use asterisk for modified indicator
+    snprintf(out, size, "%s%s", name, (index == active ? changed : d.changed) ? " *" : "");
+}
+
+int document_find(const char *path) {
+    std::vector<Document *> &d = slots();
+    for (int i = 0; i < (int)d.size(); i++) {
+        if (strcmp(i == active ? filename : d[i]->name, path) == 0) return i;
+    }
+    return -1;
+}
+
+bool document_reusable() {
+    return filename[0] == '\0' && !changed && textbuf.length() == 0 && !load_busy();
+}
+
+// --- Opening and Closing ---
+
+bool document_new() {
+    std::vector<Document *> &d = slots();
+    if (!can_leave()) return false;
+    if (spare.empty()) {
+        d.push_back(new Document);
+    } else {
+        d.push_back(spare.back());
+        spare.pop_back();
+    }
+    activate((int)d.size() - 1, true);
+    // Another untitled document may hold the untitled journal; this one then goes without
+    crash_journal.start("");
+    return true;
+}
+
+bool document_switch(int index) {
+    std::vector<Document *> &d = slots();
+    if (index < 0 || index >= (int)d.size()) return false;
+    if (index == active) return true;
+    if (!can_leave()) return false;
+    activate(index, true);
+    return true;
+}
+
+bool document_close() {
+    std::vector<Document *> &d = slots();
+    if (load_busy()) {
+        load_cancel();
+        changed = 0; // The part that had arrived is not an edit of the user's
+    }
+    if (!check_save()) return false;
+    crash_journal.stop(); // Saved or discarded
+    if (d.size() == 1) {
+        clear_active();
+        return true;
+    }
+    int closing = active;
+    activate(closing > 0 ? closing - 1 : 1, false);
+    Document *doc = d[closing];
+    d.erase(d.begin() + closing);
+    if (active > closing) active--;
+    recycle(doc);
+    damage_titles(); // One tab fewer
+    return true;
+}
+
+bool document_close_all() {
+    std::vector<Document *> &d = slots();
+    if (load_busy()) {
+        load_cancel();
+        changed = 0;
+    }
+    save_wait();
+    for (int i = 0; i < (int)d.size(); i++) {
+        if (i != active && !d[i]->changed) continue;
+        if (i != active) activate(i, true); // Show it while asking about it
+        if (!check_save()) return false;
+    }
+    crash_journal.stop(); // Everything was saved or discarded
+    for (Document *doc : d) doc->crash.stop();
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <cstddef> // For size_t
+
+// --- Workspace (Declarations) ---
+// Every open file is a document of the workspace, shown as a tab in each window. The
+// globals in globals.h always hold the active document: switching parks it (its piece
+// table, undo history, crash journal, name, file version, language and dirty flag move
+// into its slot) and moves the chosen one in. A parked document keeps its text only in
+// its piece table, still reading the unedited parts from its file's mapping; its file is
+// checked when it is shown again. Its styles are kept as runs (see StyleRuns.h), except
+// for a very large one, which is restyled in the background when shown again.
+// Documents are numbered from 0 in tab order.
+int document_count();
+int document_active();
+void document_label(int index, char *out, size_t size); // File name, with " *" when it has unsaved changes
+int document_find(const char *path);   // Index of the document open from 'path', or -1
+bool document_new();                   // Adds an empty untitled document and shows it
+bool document_switch(int index);       // False if the active document cannot be left yet
+bool document_reusable();              // The active document is untitled, unchanged and empty
+bool document_close();                 // Closes the active document (after asking to save it)
+bool document_close_all();             // Asks to save every changed document; false if cancelled
+
+#endif // WORKSPACE_H